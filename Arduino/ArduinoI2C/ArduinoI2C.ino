@@ -193,5 +193,16 @@ void loop() {
     return;
   }
   Serial.println(vbus);
+
+  // read position and velocity in a single transaction
+  float pos, vel;
+  success = odrive::read_axis_properties<odrive::AXIS__ENCODER__POS_ESTIMATE, odrive::AXIS__ENCODER__PLL_VEL>(odrive_num, axis_num, &pos, &vel);
+  if (!success) {
+    Serial.println("error");
+    return;
+  }
+  Serial.print(pos);
+  Serial.print(" ");
+  Serial.println(vel);
 }
 
@@ -6,6 +6,8 @@
 *   - Use read_property<PropertyId>() to read properties from the ODrive.
 *   - Use write_property<PropertyId>() to modify properties on the ODrive.
 *   - Use trigger<PropertyId>() to trigger a function (such as reboot or save_configuration)
+*   - Use read_properties<PropertyId...>() to read several properties in a
+*     single I2C transaction.
 *   - Use endpoint_type_t<PropertyId> to retrieve the underlying type
 *     of a given property.
 *   - Refer to PropertyId for a list of available properties.
@@ -56,6 +58,7 @@ bool I2C_transaction(uint8_t slave_addr, const uint8_t * tx_buffer, size_t tx_le
 
 namespace odrive {
     static constexpr const uint8_t i2c_addr = (0xD << 3); // write: 1101xxx0, read: 1101xxx1
+    static constexpr const uint16_t batch_read_address = 0x7fff; // see interface_i2c.h in the firmware
 
     template<typename T>
     using bit_width = std::integral_constant<unsigned int, CHAR_BIT * sizeof(T)>;
@@ -175,6 +178,75 @@ namespace odrive {
     }
 
 
+    /* @brief Compile-time layout of a batched read.
+    * batch<PropertyId...>::size is the total number of bytes of the response.
+    * The values of the properties are concatenated without padding, in the
+    * order in which they were requested.
+    */
+    template<int... IPropertyIds>
+    struct batch;
+
+    template<>
+    struct batch<> {
+        static constexpr unsigned int size = 0;
+        static void write_ids(uint8_t buffer[], uint16_t id_offset) {}
+        static void read_values(const uint8_t buffer[]) {}
+    };
+
+    template<int IPropertyId, int... IPropertyIds>
+    struct batch<IPropertyId, IPropertyIds...> {
+        using value_type = endpoint_type_t<IPropertyId>;
+        static constexpr unsigned int size = byte_width<value_type>::value + batch<IPropertyIds...>::size;
+
+        static void write_ids(uint8_t buffer[], uint16_t id_offset) {
+            write_le<uint16_t>(buffer, IPropertyId + id_offset);
+            batch<IPropertyIds...>::write_ids(buffer + 2, id_offset);
+        }
+
+        static void read_values(const uint8_t buffer[], value_type* value, endpoint_type_t<IPropertyIds>*... values) {
+            if (value)
+                *value = read_le<value_type>(buffer);
+            batch<IPropertyIds...>::read_values(buffer + byte_width<value_type>::value, values...);
+        }
+    };
+
+    /* @brief Read several endpoints from the ODrive in a single I2C transaction.
+    * To read axis specific endpoints use read_axis_properties() instead.
+    *
+    * Usage example:
+    *   float vbus;
+    *   uint32_t uptime;
+    *   success = odrive::read_properties<odrive::VBUS_VOLTAGE, odrive::SYSTEM_STATS__UPTIME>(0, &vbus, &uptime);
+    *
+    * Note that many I2C libraries limit the size of a transaction (32 bytes
+    * for the Arduino Wire library). The request takes 2 bytes per property
+    * plus 4 bytes and the response takes batch<...>::size bytes.
+    *
+    * @param num Selects the ODrive. For instance the value 4 selects
+    * the ODrive that has [A2, A1, A0] connected to [VCC, GND, GND].
+    * @return true if the I2C transaction succeeded, false otherwise
+    */
+    template<int... IPropertyIds>
+    bool read_properties(uint8_t num, endpoint_type_t<IPropertyIds>*... values, uint16_t id_offset = 0) {
+        static_assert(sizeof...(IPropertyIds) > 0, "at least one property must be requested");
+        uint8_t i2c_tx_buffer[4 + 2 * sizeof...(IPropertyIds)];
+        write_le<uint16_t>(i2c_tx_buffer, batch_read_address);
+        batch<IPropertyIds...>::write_ids(i2c_tx_buffer + 2, id_offset);
+        write_le<uint16_t>(i2c_tx_buffer + sizeof(i2c_tx_buffer) - 2, json_crc);
+        uint8_t i2c_rx_buffer[batch<IPropertyIds...>::size];
+        if (!I2C_transaction(i2c_addr + num,
+            i2c_tx_buffer, sizeof(i2c_tx_buffer),
+            i2c_rx_buffer, sizeof(i2c_rx_buffer)))
+            return false;
+        batch<IPropertyIds...>::read_values(i2c_rx_buffer, values...);
+        return true;
+    }
+
+    template<int... IPropertyIds>
+    bool read_axis_properties(uint8_t num, uint8_t axis, endpoint_type_t<IPropertyIds>*... values) {
+        return read_properties<IPropertyIds...>(num, values..., axis * per_axis_offset);
+    }
+
     /* @brief Checks if the axis is in the requested state and the error register is clear */
     bool check_axis_state(uint8_t num, uint8_t axis, uint8_t state) {
         endpoint_type_t<odrive::AXIS__CURRENT_STATE> observed_state = 0;
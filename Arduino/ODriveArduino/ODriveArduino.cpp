@@ -2,6 +2,9 @@
 #include "Arduino.h"
 #include "ODriveArduino.h"
 
+#include <math.h>
+#include <stdlib.h>
+
 static const int kMotorOffsetFloat = 2;
 static const int kMotorStrideFloat = 28;
 static const int kMotorOffsetInt32 = 0;
@@ -11,9 +14,12 @@ static const int kMotorStrideBool = 4;
 static const int kMotorOffsetUint16 = 0;
 static const int kMotorStrideUint16 = 2;
 
+static const unsigned long kRunStatePollInterval = 100; // [ms]
+static const int kRunStateMaxPolls = 100;
+
 // Print with stream operator
-template<class T> inline Print& operator <<(Print &obj,     T arg) { obj.print(arg);    return obj; }
-template<>        inline Print& operator <<(Print &obj, float arg) { obj.print(arg, 4); return obj; }
+// Floats are not printed with this operator (see writeFloat())
+template<class T> inline Print& operator <<(Print &obj, T arg) { obj.print(arg); return obj; }
 
 ODriveArduino::ODriveArduino(Stream& serial)
     : serial_(serial) {}
@@ -27,7 +33,13 @@ void ODriveArduino::SetPosition(int motor_number, float position, float velocity
 }
 
 void ODriveArduino::SetPosition(int motor_number, float position, float velocity_feedforward, float current_feedforward) {
-    serial_ << "p " << motor_number  << " " << position << " " << velocity_feedforward << " " << current_feedforward << "\n";
+    serial_ << "p " << motor_number << " ";
+    writeFloat(position);
+    serial_ << " ";
+    writeFloat(velocity_feedforward);
+    serial_ << " ";
+    writeFloat(current_feedforward);
+    serial_ << "\n";
 }
 
 void ODriveArduino::SetVelocity(int motor_number, float velocity) {
@@ -35,19 +47,29 @@ void ODriveArduino::SetVelocity(int motor_number, float velocity) {
 }
 
 void ODriveArduino::SetVelocity(int motor_number, float velocity, float current_feedforward) {
-    serial_ << "v " << motor_number  << " " << velocity << " " << current_feedforward << "\n";
+    serial_ << "v " << motor_number << " ";
+    writeFloat(velocity);
+    serial_ << " ";
+    writeFloat(current_feedforward);
+    serial_ << "\n";
 }
 
 void ODriveArduino::SetCurrent(int motor_number, float current) {
-    serial_ << "c " << motor_number << " " << current << "\n";
+    serial_ << "c " << motor_number << " ";
+    writeFloat(current);
+    serial_ << "\n";
 }
 
 void ODriveArduino::TrapezoidalMove(int motor_number, float position){
-    serial_ << "t " << motor_number << " " << position << "\n";
+    serial_ << "t " << motor_number << " ";
+    writeFloat(position);
+    serial_ << "\n";
 }
 
+// Blocks until a response line is received (or the timeout expires).
+// Don't mix with the non-blocking interface while requests are pending.
 float ODriveArduino::readFloat() {
-    return readString().toFloat();
+    return readLine() ? strtod(line_, nullptr) : 0.0f;
 }
 
 float ODriveArduino::GetVelocity(int motor_number){
@@ -56,36 +78,272 @@ float ODriveArduino::GetVelocity(int motor_number){
 }
 
 int32_t ODriveArduino::readInt() {
-    return readString().toInt();
+    return readLine() ? strtol(line_, nullptr, 10) : 0;
 }
 
 bool ODriveArduino::run_state(int axis, int requested_state, bool wait) {
-    int timeout_ctr = 100;
+    if (!runStateAsync(axis, requested_state, wait))
+        return false;
+    while (run_state_status_ == RUN_STATE_BUSY)
+        poll();
+    return run_state_status_ != RUN_STATE_TIMEOUT;
+}
+
+// @brief Sends "r <property>". The response is stored in the request once it arrives.
+// @returns false if too many requests are pending or the late responses of
+// timed out requests are still being discarded
+bool ODriveArduino::requestProperty(const char* property, Request& request) {
+    if (!enqueue(request))
+        return false;
+    serial_ << "r " << property << "\n";
+    return true;
+}
+
+// @brief Sends "r axis<axis>.<property>"
+bool ODriveArduino::requestAxisProperty(int axis, const char* property, Request& request) {
+    if (!enqueue(request))
+        return false;
+    serial_ << "r axis" << axis << "." << property << "\n";
+    return true;
+}
+
+// @brief Sends "f <motor_number>". The request receives position and velocity estimate.
+bool ODriveArduino::requestFeedback(int motor_number, Request& request) {
+    if (!enqueue(request))
+        return false;
+    serial_ << "f " << motor_number << "\n";
+    return true;
+}
+
+// @brief Requests a state change without blocking.
+// If wait is true, the current state is polled from poll() until the axis
+// returns to idle. The progress is reported by runStateStatus().
+// @returns false if another state change is still in progress
+bool ODriveArduino::runStateAsync(int axis, int requested_state, bool wait) {
+    if (run_state_status_ == RUN_STATE_BUSY)
+        return false;
     serial_ << "w axis" << axis << ".requested_state " << requested_state << '\n';
-    if (wait) {
-        do {
-            delay(100);
-            serial_ << "r axis" << axis << ".current_state\n";
-        } while (readInt() != AXIS_STATE_IDLE && --timeout_ctr > 0);
+    run_state_axis_ = axis;
+    run_state_request_.state = Request::IDLE;
+    run_state_polls_left_ = kRunStateMaxPolls;
+    run_state_last_poll_ = millis();
+    run_state_status_ = wait ? RUN_STATE_BUSY : RUN_STATE_DONE;
+    return true;
+}
+
+// @brief Processes all received bytes without blocking and completes the
+// pending requests.
+void ODriveArduino::poll() {
+    while (serial_.available()) {
+        char c = serial_.read();
+        if (c == '\n') {
+            line_[line_length_] = '\0';
+            handleLine();
+            line_length_ = 0;
+            line_overflow_ = false;
+        } else if (c == '\r') {
+            // ignore
+        } else if (line_length_ < kMaxLineLength) {
+            line_[line_length_++] = c;
+        } else {
+            line_overflow_ = true;
+        }
+    }
+
+    // Responses arrive in order, so only the oldest request can time out.
+    // A late response would be matched to the next request, so all pending
+    // requests fail and their responses are discarded when they arrive.
+    if (pending_count_ && millis() - pending_[pending_head_]->sent_at >= kTimeout) {
+        stale_lines_ += pending_count_;
+        stale_at_ = millis();
+        while (pending_count_) {
+            Request& request = *pending_[pending_head_];
+            pending_head_ = (pending_head_ + 1) % kMaxPendingRequests;
+            pending_count_--;
+            finish(request, Request::FAILED);
+        }
     }
 
-    return timeout_ctr > 0;
+    // Give up on responses that didn't arrive at all
+    if (stale_lines_ && millis() - stale_at_ >= kTimeout)
+        stale_lines_ = 0;
+
+    if (run_state_status_ == RUN_STATE_BUSY && run_state_request_.state != Request::PENDING) {
+        if (run_state_request_.state == Request::DONE && run_state_request_.int_value == AXIS_STATE_IDLE) {
+            run_state_status_ = RUN_STATE_DONE;
+        } else if (run_state_polls_left_ <= 0) {
+            run_state_status_ = RUN_STATE_TIMEOUT;
+        } else if (millis() - run_state_last_poll_ >= kRunStatePollInterval) {
+            if (requestAxisProperty(run_state_axis_, "current_state", run_state_request_)) {
+                run_state_last_poll_ = millis();
+                run_state_polls_left_--;
+            }
+        }
+    }
+}
+
+bool ODriveArduino::enqueue(Request& request) {
+    // New requests must wait until the stream is in sync again
+    if (stale_lines_ || pending_count_ >= kMaxPendingRequests)
+        return false;
+    request.state = Request::PENDING;
+    request.count = 0;
+    request.sent_at = millis();
+    pending_[(pending_head_ + pending_count_) % kMaxPendingRequests] = &request;
+    pending_count_++;
+    return true;
 }
 
-String ODriveArduino::readString() {
-    String str = "";
-    static const unsigned long timeout = 1000;
+void ODriveArduino::handleLine() {
+    if (stale_lines_) {
+        stale_lines_--; // late response of a request that timed out
+        stale_at_ = millis();
+        return;
+    }
+    if (!pending_count_)
+        return; // unsolicited line (e.g. an error message)
+    Request& request = *pending_[pending_head_];
+    pending_head_ = (pending_head_ + 1) % kMaxPendingRequests;
+    pending_count_--;
+
+    if (line_overflow_) {
+        finish(request, Request::FAILED);
+        return;
+    }
+
+    // Parse up to kMaxValues space separated numbers
+    const char* ptr = line_;
+    request.int_value = strtol(ptr, nullptr, 10);
+    while (request.count < kMaxValues) {
+        char* end;
+        float value = strtod(ptr, &end);
+        if (end == ptr)
+            break;
+        request.values[request.count++] = value;
+        ptr = end;
+    }
+    while (*ptr == ' ')
+        ptr++;
+
+    // Anything that isn't a number (e.g. "invalid property") fails the request
+    finish(request, (request.count && !*ptr) ? Request::DONE : Request::FAILED);
+}
+
+void ODriveArduino::finish(Request& request, Request::State_t state) {
+    request.state = state;
+    if (request.callback)
+        request.callback(request, request.ctx);
+}
+
+// Reads a line into line_ without allocating memory
+bool ODriveArduino::readLine() {
     unsigned long timeout_start = millis();
+    line_length_ = 0;
     for (;;) {
         while (!serial_.available()) {
-            if (millis() - timeout_start >= timeout) {
-                return str;
+            if (millis() - timeout_start >= kTimeout) {
+                line_[line_length_] = '\0';
+                line_length_ = 0;
+                return false;
             }
         }
         char c = serial_.read();
         if (c == '\n')
             break;
-        str += c;
+        if (line_length_ < kMaxLineLength)
+            line_[line_length_++] = c;
+    }
+    line_[line_length_] = '\0';
+    line_length_ = 0;
+    return true;
+}
+
+// Prints a float with 9 significant digits (Print::print(float) is limited to
+// a fixed number of decimals and can't print large values).
+// Where double has 64 bits (e.g. ARM, ESP32) this reproduces any float exactly
+// on the ODrive. On AVR double is the same as float, so the scaling below
+// rounds and the value can be off by a few ULP.
+void ODriveArduino::writeFloat(float value) {
+    if (isnan(value)) {
+        serial_ << "nan";
+        return;
+    }
+    if (value < 0.0f) {
+        serial_ << "-";
+        value = -value;
+    }
+    if (isinf(value)) {
+        serial_ << "inf";
+        return;
+    }
+    if (value == 0.0f) {
+        serial_ << "0";
+        return;
+    }
+
+    // Scale the value to a 9 digit integer, in two steps so that the scale
+    // factor doesn't overflow for very small values
+    int exponent = (int)floor(log10(value));
+    int shift = 8 - exponent;
+    double scaled = value;
+    if (shift > 30) {
+        scaled *= 1e30;
+        shift -= 30;
+    }
+    scaled *= pow(10.0, shift);
+    while (scaled >= 999999999.5) {
+        scaled /= 10.0;
+        exponent++;
+    }
+    while (scaled < 99999999.5) {
+        scaled *= 10.0;
+        exponent--;
+    }
+    uint32_t mantissa = (uint32_t)(scaled + 0.5);
+
+    char digits[10];
+    for (int i = 8; i >= 0; --i) {
+        digits[i] = '0' + mantissa % 10;
+        mantissa /= 10;
+    }
+    int n_digits = 9;
+    while (n_digits > 1 && digits[n_digits - 1] == '0')
+        n_digits--;
+
+    char buf[20];
+    size_t pos = 0;
+    if (exponent >= 0 && exponent < 9) {
+        // plain notation, e.g. "1234.5"
+        for (int i = 0; i <= exponent || i < n_digits; ++i) {
+            if (i == exponent + 1)
+                buf[pos++] = '.';
+            buf[pos++] = i < n_digits ? digits[i] : '0';
+        }
+    } else if (exponent < 0 && exponent >= -4) {
+        // plain notation, e.g. "0.00125"
+        buf[pos++] = '0';
+        buf[pos++] = '.';
+        for (int i = -1; i > exponent; --i)
+            buf[pos++] = '0';
+        for (int i = 0; i < n_digits; ++i)
+            buf[pos++] = digits[i];
+    } else {
+        // exponential notation, e.g. "1.5e-07"
+        buf[pos++] = digits[0];
+        if (n_digits > 1) {
+            buf[pos++] = '.';
+            for (int i = 1; i < n_digits; ++i)
+                buf[pos++] = digits[i];
+        }
+        buf[pos++] = 'e';
+        if (exponent < 0) {
+            buf[pos++] = '-';
+            exponent = -exponent;
+        }
+        if (exponent >= 10)
+            buf[pos++] = '0' + exponent / 10;
+        buf[pos++] = '0' + exponent % 10;
     }
-    return str;
+    buf[pos] = '\0';
+    serial_ << buf;
 }
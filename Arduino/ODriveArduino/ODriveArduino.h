@@ -18,6 +18,37 @@ public:
         AXIS_STATE_CLOSED_LOOP_CONTROL = 8  //<! run closed loop control
     };
 
+    static const size_t kMaxLineLength = 64;
+    static const size_t kMaxPendingRequests = 8;
+    static const size_t kMaxValues = 4;
+    static const unsigned long kTimeout = 1000; // [ms]
+
+    // A request that is answered asynchronously by the ODrive.
+    // The memory of the request is owned by the caller and must stay valid
+    // until the request is no longer pending.
+    struct Request {
+        enum State_t {
+            IDLE,
+            PENDING,
+            DONE,
+            FAILED,  //<! timeout or malformed response
+        };
+        volatile State_t state = IDLE;
+        uint8_t count = 0;           //<! number of values in the response
+        float values[kMaxValues];    //<! response values
+        int32_t int_value = 0;       //<! first response value, parsed as integer
+        void (*callback)(Request& request, void* ctx) = nullptr; //<! called on completion (optional)
+        void* ctx = nullptr;
+        unsigned long sent_at = 0;
+    };
+
+    enum RunStateStatus_t {
+        RUN_STATE_IDLE,     //<! no state change in progress
+        RUN_STATE_BUSY,     //<! waiting for the axis to return to idle
+        RUN_STATE_DONE,     //<! the axis returned to idle
+        RUN_STATE_TIMEOUT,  //<! the axis didn't return to idle in time
+    };
+
     ODriveArduino(Stream& serial);
 
     // Commands
@@ -36,10 +67,45 @@ public:
 
     // State helper
     bool run_state(int axis, int requested_state, bool wait);
+
+    // Non-blocking interface
+    // Requests are pipelined: several requests can be sent before the first
+    // one is answered. Call poll() regularly (e.g. from loop()) to process
+    // the responses.
+    bool requestProperty(const char* property, Request& request);
+    bool requestAxisProperty(int axis, const char* property, Request& request);
+    bool requestFeedback(int motor_number, Request& request);
+    bool runStateAsync(int axis, int requested_state, bool wait);
+    RunStateStatus_t runStateStatus() { return run_state_status_; }
+    void poll();
+
 private:
-    String readString();
+    bool enqueue(Request& request);
+    void handleLine();
+    void finish(Request& request, Request::State_t state);
+    bool readLine();
+    void writeFloat(float value);
 
     Stream& serial_;
+
+    // Response parser state
+    char line_[kMaxLineLength + 1];
+    size_t line_length_ = 0;
+    bool line_overflow_ = false;
+
+    // Pending requests in the order in which they were sent
+    Request* pending_[kMaxPendingRequests];
+    size_t pending_head_ = 0;
+    size_t pending_count_ = 0;
+    size_t stale_lines_ = 0;        //<! late responses to discard after a timeout
+    unsigned long stale_at_ = 0;
+
+    // Non-blocking run_state
+    RunStateStatus_t run_state_status_ = RUN_STATE_IDLE;
+    int run_state_axis_ = 0;
+    int run_state_polls_left_ = 0;
+    unsigned long run_state_last_poll_ = 0;
+    Request run_state_request_;
 };
 
 #endif //ODriveArduino_h
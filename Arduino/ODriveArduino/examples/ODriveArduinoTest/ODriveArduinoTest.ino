@@ -13,6 +13,16 @@ SoftwareSerial odrive_serial(8, 9); //RX (ODrive TX), TX (ODrive RX)
 // ODrive object
 ODriveArduino odrive(odrive_serial);
 
+// Request for the bus voltage, completed by odrive.poll()
+ODriveArduino::Request vbus_request;
+
+void on_vbus_voltage(ODriveArduino::Request& request, void* ctx) {
+  if (request.state == ODriveArduino::Request::DONE)
+    Serial << "Vbus voltage: " << request.values[0] << '\n';
+  else
+    Serial << "Vbus voltage: no response\n";
+}
+
 void setup() {
   // ODrive uses 115200 baud
   odrive_serial.begin(115200);
@@ -21,6 +31,8 @@ void setup() {
   Serial.begin(115200);
   while (!Serial) ; // wait for Arduino Serial Monitor to open
 
+  vbus_request.callback = on_vbus_voltage;
+
   Serial.println("ODriveArduino");
   Serial.println("Setting parameters...");
 
@@ -76,9 +88,9 @@ void loop() {
     }
 
     // Read bus voltage
+    // The response is printed from the callback once it arrives (see odrive.poll() below)
     if (c == 'b') {
-      odrive_serial << "r vbus_voltage\n";
-      Serial << "Vbus voltage: " << odrive.readFloat() << '\n';
+      odrive.requestProperty("vbus_voltage", vbus_request);
     }
 
     // print motor positions in a 10s loop
@@ -86,12 +98,19 @@ void loop() {
       static const unsigned long duration = 10000;
       unsigned long start = millis();
       while(millis() - start < duration) {
-        for (int motor = 0; motor < 2; ++motor) {
-          odrive_serial << "r axis" << motor << ".encoder.pos_estimate\n";
-          Serial << odrive.readFloat() << '\t';
-        }
+        // Both requests are sent before the first response arrives
+        ODriveArduino::Request pos_requests[2];
+        for (int motor = 0; motor < 2; ++motor)
+          odrive.requestAxisProperty(motor, "encoder.pos_estimate", pos_requests[motor]);
+        while (pos_requests[1].state == ODriveArduino::Request::PENDING)
+          odrive.poll();
+        for (int motor = 0; motor < 2; ++motor)
+          Serial << pos_requests[motor].values[0] << '\t';
         Serial << '\n';
       }
     }
   }
+
+  // Process responses from the ODrive without blocking
+  odrive.poll();
 }
@@ -0,0 +1,51 @@
+#ifndef __ABS_SPI_H
+#define __ABS_SPI_H
+
+// Protocol of the absolute SPI encoders (see Encoder::MODE_SPI_ABS_CUI and
+// Encoder::MODE_SPI_ABS_AMS). This header has no hardware dependencies, so
+// that it can be tested on the host (see test/abs_spi_test.cpp).
+
+#include <stdint.h>
+
+// Read command for the angle register (ANGLECOM) of AMS encoders, with the
+// read and parity bits set
+#define AMS_CMD_READ_ANGLECOM 0xFFFF
+
+// Decode a 16 bit response frame of an absolute SPI encoder into the 14 bit position
+// Returns 0 on success, and -1 if the check bits don't match or the encoder
+// reports an error
+
+// AMS (AS5047P, AS5048A): bit 15 is an even parity bit over the frame, bit 14
+// is the error flag and bits 13:0 hold the angle.
+static inline int decode_ams_frame(uint16_t frame, uint16_t* pos) {
+    if (__builtin_parity(frame) || (frame & 0x4000))
+        return -1;
+    *pos = frame & 0x3FFF;
+    return 0;
+}
+
+// CUI (AMT23): bits 15 and 14 are odd parity bits over the odd and even
+// bits of the frame, bits 13:0 hold the position.
+static inline int decode_cui_frame(uint16_t frame, uint16_t* pos) {
+    if (!__builtin_parity(frame & 0xAAAA) || !__builtin_parity(frame & 0x5555))
+        return -1;
+    *pos = frame & 0x3FFF;
+    return 0;
+}
+
+// Splits a 14 bit absolute position into whole encoder counts [0, cpr) and
+// the fraction of a count
+static inline void abs_spi_pos_to_count(uint16_t pos, int cpr, int32_t* count, float* fraction) {
+    float pos_counts = (float)pos * ((float)cpr / (float)(1 << 14));
+    *count = (int32_t)pos_counts;
+    *fraction = pos_counts - (float)*count;
+}
+
+// Age of the position in an absolute SPI frame when it's processed, in control
+// periods. The frames are consumed one period after they were transferred, and
+// AMS encoders return the angle latched during the previous transfer.
+static inline float abs_spi_latency_periods(bool is_ams) {
+    return is_ams ? 2.0f : 1.0f;
+}
+
+#endif // __ABS_SPI_H
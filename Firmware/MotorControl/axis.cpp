@@ -270,20 +270,124 @@ bool Axis::run_lockin_spin(const LockinConfig_t &lockin_config) {
     return check_for_errors();
 }
 
+// @brief Returns a copy of lockin_config that finishes after spinning
+// measurement_distance [rad] at constant velocity, for measurements that run
+// during LOCKIN_STATE_CONST_VEL.
+Axis::LockinConfig_t Axis::make_measurement_lockin(const LockinConfig_t& lockin_config, float measurement_distance) {
+    LockinConfig_t config = lockin_config;
+    float ramp_vel = config.ramp_distance / config.ramp_time;
+    float accel_distance = std::max(config.vel * config.vel - ramp_vel * ramp_vel, 0.0f)
+                           / (2.0f * fabsf(config.accel));
+    config.finish_on_vel = false;
+    config.finish_on_enc_idx = false;
+    config.finish_on_distance = true;
+    config.finish_distance = fabsf(config.ramp_distance) + accel_distance + measurement_distance;
+    return config;
+}
+
+// @brief Measures the permanent magnet flux linkage for the sensorless estimator.
+// The motor is spun up open loop with the sensorless ramp and the back-EMF
+// is measured for kMeasurementTime at constant velocity.
+bool Axis::run_flux_linkage_calibration() {
+    static const float kMeasurementTime = 2.0f; // [s]
+
+    LockinConfig_t lockin_config = make_measurement_lockin(config_.sensorless_ramp,
+            fabsf(config_.sensorless_ramp.vel) * kMeasurementTime);
+    motor_.back_emf_sum_ = 0.0f;
+    motor_.back_emf_vel_sum_ = 0.0f;
+    motor_.measure_back_emf_ = true;
+    bool status = run_lockin_spin(lockin_config);
+    motor_.measure_back_emf_ = false;
+    if (!status)
+        return false;
+
+    float flux_linkage = motor_.back_emf_sum_ / motor_.back_emf_vel_sum_;
+    if (!(flux_linkage > 0.0f && flux_linkage < 1.0f)) { // Funny polarity to also catch NaN
+        sensorless_estimator_.error_ |= SensorlessEstimator::ERROR_FLUX_LINKAGE_OUT_OF_RANGE;
+        error_ |= ERROR_SENSORLESS_ESTIMATOR_FAILED;
+        return false;
+    }
+    sensorless_estimator_.config_.pm_flux_linkage = flux_linkage;
+    return true;
+}
+
+// @brief Tries to catch a rotor that is still spinning.
+// The current is held at zero, so that the applied voltage equals the
+// back-EMF, which lets the sensorless estimator lock onto the rotor.
+// @param caught: set to true if the PLL locked above flying_start_min_vel
+// within flying_start_timeout.
+bool Axis::run_flying_start(bool* caught) {
+    static const float kMaxPhaseError = 0.1f; // [rad]
+    static const float kLockTime = 0.01f; // [s]
+    const uint32_t lock_cycles = static_cast<uint32_t>(kLockTime * current_meas_hz);
+    const uint32_t timeout_cycles = static_cast<uint32_t>(config_.flying_start_timeout * current_meas_hz);
+    uint32_t cycles = 0;
+    uint32_t locked_cycles = 0;
+
+    run_control_loop([&](){
+        if (!motor_.update(0.0f, sensorless_estimator_.phase_, sensorless_estimator_.vel_estimate_))
+            return false;
+        float phase_error = wrap_pm_pi(sensorless_estimator_.phase_ - sensorless_estimator_.pll_pos_);
+        if (fabsf(phase_error) < kMaxPhaseError
+                && fabsf(sensorless_estimator_.vel_estimate_) >= config_.flying_start_min_vel)
+            ++locked_cycles;
+        else
+            locked_cycles = 0;
+        return locked_cycles < lock_cycles && ++cycles < timeout_cycles;
+    });
+
+    *caught = locked_cycles >= lock_cycles;
+    return check_for_errors();
+}
+
+// @brief Finds the rotor position at standstill with high frequency injection.
+// Returns once the magnet polarity is known and the HFI estimate can be used.
+bool Axis::run_hfi_startup() {
+    if (!sensorless_estimator_.start_hfi(true))
+        return error_ |= ERROR_SENSORLESS_ESTIMATOR_FAILED, false;
+    run_control_loop([this](){
+        motor_.Vd_injection_ = sensorless_estimator_.hfi_voltage_;
+        motor_.Id_injection_ = sensorless_estimator_.hfi_Id_;
+        if (!motor_.update(0.0f, sensorless_estimator_.phase_, sensorless_estimator_.vel_estimate_))
+            return false;
+        return sensorless_estimator_.hfi_state_ != SensorlessEstimator::HFI_STATE_RUNNING;
+    });
+    if (!check_for_errors()) {
+        sensorless_estimator_.stop_hfi();
+        motor_.Vd_injection_ = 0.0f;
+        motor_.Id_injection_ = 0.0f;
+        return false;
+    }
+    return true;
+}
+
 // Note run_sensorless_control_loop and run_closed_loop_control_loop are very similar and differ only in where we get the estimate from.
 bool Axis::run_sensorless_control_loop() {
-    run_control_loop([this](){
-        if (controller_.config_.control_mode >= Controller::CTRL_MODE_POSITION_CONTROL)
+    // Position control needs the HFI to hold the position at standstill
+    bool hfi = sensorless_estimator_.config_.enable_hfi;
+    if (hfi && sensorless_estimator_.hfi_state_ == SensorlessEstimator::HFI_STATE_INACTIVE
+            && !sensorless_estimator_.start_hfi(false))
+        return error_ |= ERROR_SENSORLESS_ESTIMATOR_FAILED, false;
+    controller_.pos_setpoint_ = sensorless_estimator_.pos_estimate_;
+
+    run_control_loop([this, hfi](){
+        if (controller_.config_.control_mode >= Controller::CTRL_MODE_POSITION_CONTROL && !hfi)
             return error_ |= ERROR_POS_CTRL_DURING_SENSORLESS, false;
 
         // Note that all estimators are updated in the loop prefix in run_control_loop
         float current_setpoint;
-        if (!controller_.update(sensorless_estimator_.pll_pos_, sensorless_estimator_.vel_estimate_, &current_setpoint))
+        if (!controller_.update(sensorless_estimator_.pos_estimate_, sensorless_estimator_.vel_estimate_, &current_setpoint))
             return error_ |= ERROR_CONTROLLER_FAILED, false;
+        motor_.Vd_injection_ = sensorless_estimator_.hfi_voltage_;
+        motor_.Id_injection_ = sensorless_estimator_.hfi_Id_;
         if (!motor_.update(current_setpoint, sensorless_estimator_.phase_, sensorless_estimator_.vel_estimate_))
             return false; // set_error should update axis.error_
         return true;
     });
+
+    sensorless_estimator_.stop_hfi();
+    motor_.Vd_injection_ = 0.0f;
+    motor_.Id_injection_ = 0.0f;
     return check_for_errors();
 }
 
@@ -350,6 +454,8 @@ void Axis::run_state_machine_loop() {
                 task_chain_[pos++] = AXIS_STATE_IDLE;
             } else if (requested_state_ == AXIS_STATE_FULL_CALIBRATION_SEQUENCE) {
                 task_chain_[pos++] = AXIS_STATE_MOTOR_CALIBRATION;
+                if (encoder_.config_.mode == Encoder::MODE_SINCOS)
+                    task_chain_[pos++] = AXIS_STATE_ENCODER_SINCOS_CALIBRATION;
                 if (encoder_.config_.use_index)
                     task_chain_[pos++] = AXIS_STATE_ENCODER_INDEX_SEARCH;
                 task_chain_[pos++] = AXIS_STATE_ENCODER_OFFSET_CALIBRATION;
@@ -402,14 +508,39 @@ void Axis::run_state_machine_loop() {
                 status = run_lockin_spin(config_.lockin);
             } break;
 
+            case AXIS_STATE_ENCODER_SINCOS_CALIBRATION: {
+                if (!motor_.is_calibrated_)
+                    goto invalid_state_label;
+                status = encoder_.run_sincos_calibration();
+            } break;
+
+            case AXIS_STATE_FLUX_LINKAGE_CALIBRATION: {
+                if (!motor_.is_calibrated_ || motor_.config_.direction==0)
+                    goto invalid_state_label;
+                status = run_flux_linkage_calibration();
+            } break;
+
             case AXIS_STATE_SENSORLESS_CONTROL: {
                 if (!motor_.is_calibrated_ || motor_.config_.direction==0)
                         goto invalid_state_label;
-                status = run_lockin_spin(config_.sensorless_ramp); // TODO: restart if desired
+                bool caught = false;
+                bool hfi = sensorless_estimator_.config_.enable_hfi;
+                status = !config_.sensorless_flying_start || run_flying_start(&caught);
+                if (status && !caught) {
+                    if (hfi)
+                        status = run_hfi_startup();
+                    else
+                        status = run_lockin_spin(config_.sensorless_ramp); // TODO: restart if desired
+                }
                 if (status) {
                     // call to controller.reset() that happend when arming means that vel_setpoint
-                    // is zeroed. So we make the setpoint the spinup target for smooth transition.
-                    controller_.vel_setpoint_ = config_.sensorless_ramp.vel;
+                    // is zeroed. So we make the setpoint the spinup target (or the speed at which
+                    // the rotor was caught) for smooth transition. With HFI, the motor starts
+                    // from standstill.
+                    if (caught)
+                        controller_.vel_setpoint_ = sensorless_estimator_.vel_estimate_;
+                    else if (!hfi)
+                        controller_.vel_setpoint_ = config_.sensorless_ramp.vel;
                     status = run_sensorless_control_loop();
                 }
             } break;
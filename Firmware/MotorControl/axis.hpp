@@ -35,6 +35,8 @@ public:
         AXIS_STATE_CLOSED_LOOP_CONTROL = 8,  //<! run closed loop control
         AXIS_STATE_LOCKIN_SPIN = 9,       //<! run lockin spin
         AXIS_STATE_ENCODER_DIR_FIND = 10,
+        AXIS_STATE_FLUX_LINKAGE_CALIBRATION = 11, //<! measure the flux linkage for sensorless control
+        AXIS_STATE_ENCODER_SINCOS_CALIBRATION = 12, //<! measure the sin/cos signal correction
     };
 
     struct LockinConfig_t {
@@ -52,6 +54,7 @@ public:
     static LockinConfig_t default_calibration();
     static LockinConfig_t default_sensorless();
     static LockinConfig_t default_lockin();
+    static LockinConfig_t make_measurement_lockin(const LockinConfig_t& lockin_config, float measurement_distance);
 
     struct Config_t {
         bool startup_motor_calibration = false;   //<! run motor calibration at startup, skip otherwise
@@ -60,6 +63,9 @@ public:
         bool startup_encoder_offset_calibration = false; //<! run encoder offset calibration after startup, skip otherwise
         bool startup_closed_loop_control = false; //<! enable closed loop control after calibration/startup
         bool startup_sensorless_control = false; //<! enable sensorless control after calibration/startup
+        bool sensorless_flying_start = false; //<! try to catch a spinning motor before running the sensorless ramp
+        float flying_start_min_vel = 200.0f; // [rad/s] electrical, below this the sensorless ramp is used
+        float flying_start_timeout = 0.1f; // [s]
         bool enable_step_dir = false; //<! enable step/dir input after calibration
                                     //   For M0 this has no effect if enable_uart is true
         float counts_per_step = 2.0f;
@@ -184,6 +190,9 @@ public:
     }
 
     bool run_lockin_spin(const LockinConfig_t &lockin_config);
+    bool run_flux_linkage_calibration();
+    bool run_flying_start(bool* caught);
+    bool run_hfi_startup();
     bool run_sensorless_control_loop();
     bool run_closed_loop_control_loop();
     bool run_idle_loop();
@@ -238,6 +247,9 @@ public:
                 make_protocol_property("startup_encoder_offset_calibration", &config_.startup_encoder_offset_calibration),
                 make_protocol_property("startup_closed_loop_control", &config_.startup_closed_loop_control),
                 make_protocol_property("startup_sensorless_control", &config_.startup_sensorless_control),
+                make_protocol_property("sensorless_flying_start", &config_.sensorless_flying_start),
+                make_protocol_property("flying_start_min_vel", &config_.flying_start_min_vel),
+                make_protocol_property("flying_start_timeout", &config_.flying_start_timeout),
                 make_protocol_property("enable_step_dir", &config_.enable_step_dir),
                 make_protocol_property("counts_per_step", &config_.counts_per_step),
                 make_protocol_property("watchdog_timeout", &config_.watchdog_timeout,
@@ -54,6 +54,11 @@ void Controller::move_to_pos(float goal_point) {
                                  axis_->trap_.config_.vel_limit,
                                  axis_->trap_.config_.accel_limit,
                                  axis_->trap_.config_.decel_limit);
+    start_trajectory(goal_point);
+}
+
+// @brief Starts following the trajectory that was planned in axis_->trap_
+void Controller::start_trajectory(float goal_point) {
     traj_start_loop_count_ = axis_->loop_counter_;
     config_.control_mode = CTRL_MODE_TRAJECTORY_CONTROL;
     goal_point_ = goal_point;
@@ -1,6 +1,10 @@
 
 #include "odrive_main.h"
+#include "abs_spi.h"
 
+static bool is_abs_spi_mode(Encoder::Mode_t mode) {
+    return mode == Encoder::MODE_SPI_ABS_CUI || mode == Encoder::MODE_SPI_ABS_AMS;
+}
 
 Encoder::Encoder(const EncoderHardwareConfig_t& hw_config,
                 Config_t& config) :
@@ -9,7 +13,8 @@ Encoder::Encoder(const EncoderHardwareConfig_t& hw_config,
 {
     update_pll_gains();
 
-    if (config.pre_calibrated && (config.mode == Encoder::MODE_HALL || config.mode == Encoder::MODE_SINCOS)) {
+    // SinCos is handled in setup(), because it depends on the motor's pole pairs
+    if (config.pre_calibrated && (config.mode == Encoder::MODE_HALL || is_abs_spi_mode(config.mode))) {
         is_ready_ = true;
     }
 }
@@ -21,6 +26,19 @@ static void enc_index_cb_wrapper(void* ctx) {
 void Encoder::setup() {
     HAL_TIM_Encoder_Start(hw_config_.timer, TIM_CHANNEL_ALL);
     set_idx_subscribe();
+    abs_spi_cs_pin_init();
+
+    if (config_.pre_calibrated && config_.mode == MODE_SINCOS && sincos_phase_is_absolute()) {
+        is_ready_ = true;
+    }
+}
+
+// @brief Checks if the electrical phase is known without knowing the starting period.
+// The period counter always starts at 0 after boot. An offset of whole periods
+// only leaves the electrical phase unchanged if the periods divide the pole pairs.
+bool Encoder::sincos_phase_is_absolute() {
+    int32_t periods = config_.sincos_periods;
+    return periods == 1 || (periods > 1 && axis_->motor_.config_.pole_pairs % periods == 0);
 }
 
 void Encoder::set_error(Error_t error) {
@@ -68,6 +86,69 @@ void Encoder::set_idx_subscribe(bool override_enable) {
     }
 }
 
+// Configures the chip select pin of absolute SPI encoders as output
+void Encoder::abs_spi_cs_pin_init() {
+    if (!is_abs_spi_mode(config_.mode))
+        return;
+
+    // Stop using the old pin before reconfiguring
+    uint32_t prim = cpu_enter_critical();
+    abs_spi_cs_port_ = nullptr;
+    cpu_exit_critical(prim);
+    while (abs_spi_dma_busy_)
+        osDelay(1);
+
+    GPIO_TypeDef* port = get_gpio_port_by_pin(config_.abs_spi_cs_gpio_pin);
+    uint16_t pin = get_gpio_pin_by_pin(config_.abs_spi_cs_gpio_pin);
+    HAL_GPIO_WritePin(port, pin, GPIO_PIN_SET);
+    GPIO_InitTypeDef GPIO_InitStruct;
+    GPIO_InitStruct.Pin = pin;
+    GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;
+    GPIO_InitStruct.Pull = GPIO_NOPULL;
+    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_VERY_HIGH;
+    HAL_GPIO_Init(port, &GPIO_InitStruct);
+
+    abs_spi_cs_pin_ = pin;
+    abs_spi_cs_port_ = port;
+}
+
+// @brief Starts reading an absolute SPI encoder.
+// Called from the PWM timer update interrupt, so the position is sampled at
+// the same time as the phase currents. The DMA completes in the background
+// and the frame is handed to update() at the next timer update (see
+// sample_now()). The SPI bus is shared between both axes and the gate
+// drivers, so the transaction is skipped if the bus is busy.
+void Encoder::abs_spi_start_transaction() {
+    SPI_HandleTypeDef* spi = hw_config_.spi;
+    abs_spi_dma_done_ = false;
+    // While a gate driver uses the bus, the frame is skipped (and extrapolated)
+    if (abs_spi_dma_busy_ || !abs_spi_cs_port_ || spi->State != HAL_SPI_STATE_READY || gate_driver_spi_claimed())
+        return;
+
+    // AMT23 is specified up to 2MHz, AS5047 up to 10MHz. The gate drivers
+    // restore their own baud rate when they claim the bus.
+    uint32_t prescaler = (config_.mode == MODE_SPI_ABS_CUI) ? SPI_BAUDRATEPRESCALER_32 : SPI_BAUDRATEPRESCALER_16;
+    if ((spi->Instance->CR1 & SPI_CR1_BR) != prescaler) {
+        __HAL_SPI_DISABLE(spi);
+        MODIFY_REG(spi->Instance->CR1, SPI_CR1_BR, prescaler);
+    }
+
+    abs_spi_dma_tx_[0] = (config_.mode == MODE_SPI_ABS_AMS) ? AMS_CMD_READ_ANGLECOM : 0x0000;
+    abs_spi_dma_busy_ = true;
+    HAL_GPIO_WritePin(abs_spi_cs_port_, abs_spi_cs_pin_, GPIO_PIN_RESET);
+    if (HAL_SPI_TransmitReceive_DMA(spi, (uint8_t*)abs_spi_dma_tx_, (uint8_t*)abs_spi_dma_rx_, 1) != HAL_OK) {
+        HAL_GPIO_WritePin(abs_spi_cs_port_, abs_spi_cs_pin_, GPIO_PIN_SET);
+        abs_spi_dma_busy_ = false;
+    }
+}
+
+// Called from the SPI DMA interrupt when the transaction is done
+void Encoder::abs_spi_cb(bool success) {
+    HAL_GPIO_WritePin(abs_spi_cs_port_, abs_spi_cs_pin_, GPIO_PIN_SET);
+    abs_spi_dma_done_ = success;
+    abs_spi_dma_busy_ = false;
+}
+
 void Encoder::update_pll_gains() {
     pll_kp_ = 2.0f * config_.bandwidth;  // basic conversion to discrete time
     pll_ki_ = 0.25f * (pll_kp_ * pll_kp_); // Critically damped
@@ -83,6 +164,8 @@ void Encoder::check_pre_calibrated() {
         config_.pre_calibrated = false;
     if (config_.mode == MODE_INCREMENTAL && !index_found_)
         config_.pre_calibrated = false;
+    if (config_.mode == MODE_SINCOS && !sincos_phase_is_absolute())
+        config_.pre_calibrated = false;
 }
 
 // Function that sets the current encoder count to a desired 32-bit value.
@@ -94,6 +177,7 @@ void Encoder::set_linear_count(int32_t count) {
     shadow_count_ = count;
     pos_estimate_ = (float)count;
     tim_cnt_sample_ = count;
+    edge_dir_ = 0; // restart the edge timing
 
     //Write hardware last
     hw_config_.timer->Instance->CNT = count;
@@ -261,6 +345,68 @@ bool Encoder::run_offset_calibration() {
     return true;
 }
 
+// @brief Measures the offsets, the relative amplitude and the quadrature
+// error of the sin/cos signals.
+// The motor is spun open loop at constant velocity over whole revolutions
+// (at least kMinPeriods periods), so that the signals are sampled evenly over
+// their periods. With s = A_s * sin(x) and c = A_c * cos(x + error), the
+// means are the offsets, the variances are A^2 / 2 and the covariance is
+// -A_s * A_c * sin(error) / 2.
+// This assumes that the encoder is on the motor shaft.
+bool Encoder::run_sincos_calibration() {
+    static const int32_t kMinPeriods = 4;
+    static const float kMinAmplitude = 0.02f; // [1] fraction of the ADC range
+    static const float kMaxQuadratureError = 0.5f; // [rad]
+
+    if (config_.mode != MODE_SINCOS || config_.sincos_periods < 1) {
+        set_error(ERROR_UNSUPPORTED_ENCODER_MODE);
+        return false;
+    }
+
+    int32_t revolutions = std::max((kMinPeriods + config_.sincos_periods - 1) / config_.sincos_periods, (int32_t)1);
+    float distance = (float)revolutions * 2.0f * M_PI * (float)axis_->motor_.config_.pole_pairs;
+    Axis::LockinConfig_t lockin_config = Axis::make_measurement_lockin(axis_->config_.calibration_lockin, distance);
+
+    sincos_calib_ = {};
+    sincos_calib_active_ = true;
+    bool status = axis_->run_lockin_spin(lockin_config);
+    sincos_calib_active_ = false;
+    if (!status)
+        return false;
+
+    const SincosCalibration_t& calib = sincos_calib_;
+    if (calib.samples == 0) {
+        set_error(ERROR_NO_RESPONSE);
+        return false;
+    }
+    float n = (float)calib.samples;
+    float mean_s = calib.s_sum / n;
+    float mean_c = calib.c_sum / n;
+    float var_s = calib.ss_sum / n - mean_s * mean_s;
+    float var_c = calib.cc_sum / n - mean_c * mean_c;
+    float cov = calib.sc_sum / n - mean_s * mean_c;
+    float amplitude_s = sqrtf(std::max(2.0f * var_s, 0.0f));
+    float amplitude_c = sqrtf(std::max(2.0f * var_c, 0.0f));
+    if (!(amplitude_s > kMinAmplitude && amplitude_c > kMinAmplitude)) {
+        set_error(ERROR_NO_RESPONSE);
+        return false;
+    }
+    float sin_error = -2.0f * cov / (amplitude_s * amplitude_c);
+    if (!(fabsf(sin_error) < sinf(kMaxQuadratureError))) {
+        set_error(ERROR_SINCOS_SIGNAL_OUT_OF_RANGE);
+        return false;
+    }
+
+    config_.sincos_offset_s = mean_s;
+    config_.sincos_offset_c = mean_c;
+    config_.sincos_gain_c = amplitude_s / amplitude_c;
+    config_.sincos_quadrature_error = asinf(sin_error);
+
+    // The phase offset has to be calibrated with the corrected signals
+    is_ready_ = false;
+    return true;
+}
+
 static bool decode_hall(uint8_t hall_state, int32_t* hall_cnt) {
     switch (hall_state) {
         case 0b001: *hall_cnt = 0; return true;
@@ -288,12 +434,46 @@ void Encoder::sample_now() {
             sincos_sample_c_ = (get_adc_voltage(GPIO_4_GPIO_Port, GPIO_4_Pin) / 3.3f) - 0.5f;
         } break;
 
+        case MODE_SPI_ABS_CUI:
+        case MODE_SPI_ABS_AMS: {
+            // Hand the frame of the last transaction to update() and start the next one
+            abs_spi_frame_valid_ = abs_spi_dma_done_;
+            abs_spi_frame_ = abs_spi_dma_rx_[0];
+            abs_spi_start_transaction();
+        } break;
+
         default: {
            set_error(ERROR_UNSUPPORTED_ENCODER_MODE);
         } break;
     }
 }
 
+// @brief Measures the speed from the time between edges (M/T method).
+// The counts are sampled once per control period, so the edges are
+// timestamped with the loop count. Counting the edges over at least
+// edge_timing_window reduces the effect of the timestamp resolution at
+// higher speeds. A reversal restarts the measurement.
+void Encoder::update_edge_timing(int32_t delta_enc) {
+    if (delta_enc == 0)
+        return;
+    int32_t dir = (delta_enc > 0) ? 1 : -1;
+    uint32_t loop_count = axis_->loop_counter_;
+    if (dir != edge_dir_) {
+        edge_speed_ = 0.0f;
+        edge_window_loop_count_ = loop_count;
+        edge_window_count_ = shadow_count_;
+    } else {
+        float window = (float)(loop_count - edge_window_loop_count_) * current_meas_period;
+        if (window >= config_.edge_timing_window && window > 0.0f) {
+            edge_speed_ = (float)abs(shadow_count_ - edge_window_count_) / window;
+            edge_window_loop_count_ = loop_count;
+            edge_window_count_ = shadow_count_;
+        }
+    }
+    edge_dir_ = dir;
+    edge_loop_count_ = loop_count;
+}
+
 bool Encoder::update() {
     // update internal encoder state.
     int32_t delta_enc = 0;
@@ -321,16 +501,90 @@ bool Encoder::update() {
         } break;
 
         case MODE_SINCOS: {
-            float phase = fast_atan2(sincos_sample_s_, sincos_sample_c_);
-            int fake_count = (int)(1000.0f * phase);
-            //CPR = 6283 = 2pi * 1k
-
-            delta_enc = fake_count - count_in_cpr_;
-            delta_enc = mod(delta_enc, 6283);
-            if (delta_enc > 6283/2)
-                delta_enc -= 6283;
+            if (sincos_calib_active_ && axis_->lockin_state_ == Axis::LOCKIN_STATE_CONST_VEL) {
+                SincosCalibration_t& calib = sincos_calib_;
+                calib.s_sum += sincos_sample_s_;
+                calib.c_sum += sincos_sample_c_;
+                calib.ss_sum += sincos_sample_s_ * sincos_sample_s_;
+                calib.cc_sum += sincos_sample_c_ * sincos_sample_c_;
+                calib.sc_sum += sincos_sample_s_ * sincos_sample_c_;
+                ++calib.samples;
+            }
+
+            // Correct offset and gain, then the quadrature error:
+            // the measured c is cos(x + error) = cos(x) * cos(error) - sin(x) * sin(error)
+            float s = sincos_sample_s_ - config_.sincos_offset_s;
+            float c = (sincos_sample_c_ - config_.sincos_offset_c) * config_.sincos_gain_c;
+            c = (c + s * our_arm_sin_f32(config_.sincos_quadrature_error)) / our_arm_cos_f32(config_.sincos_quadrature_error);
+            sincos_amplitude_ = sqrtf(s * s + c * c);
+
+            float fraction = fast_atan2(s, c) * (1.0f / (2.0f * M_PI));
+            if (fraction < 0.0f)
+                fraction += 1.0f;
+            // Track the period of multi-period encoders
+            int32_t periods = std::max(config_.sincos_periods, (int32_t)1);
+            if (fraction - sincos_fraction_ > 0.5f)
+                --sincos_period_;
+            else if (fraction - sincos_fraction_ < -0.5f)
+                ++sincos_period_;
+            sincos_period_ = mod(sincos_period_, periods);
+            sincos_fraction_ = fraction;
+
+            float counts_per_period = (float)config_.cpr / (float)periods;
+            float pos = ((float)sincos_period_ + fraction) * counts_per_period;
+            int32_t count = (int32_t)pos;
+            meas_interpolation_ = pos - (float)count;
+
+            delta_enc = count - count_in_cpr_;
+            delta_enc = mod(delta_enc, config_.cpr);
+            if (delta_enc > config_.cpr / 2)
+                delta_enc -= config_.cpr;
         } break;
-        
+
+        case MODE_SPI_ABS_CUI:
+        case MODE_SPI_ABS_AMS: {
+            static const uint32_t kMaxBadFrames = 10;
+            uint32_t prim = cpu_enter_critical();
+            uint16_t frame = abs_spi_frame_;
+            bool frame_valid = abs_spi_frame_valid_;
+            cpu_exit_critical(prim);
+
+            uint16_t raw_pos;
+            int status = (config_.mode == MODE_SPI_ABS_AMS) ? decode_ams_frame(frame, &raw_pos)
+                                                             : decode_cui_frame(frame, &raw_pos);
+            if (!frame_valid || status != 0) {
+                // Bridge single bad frames by extrapolating
+                ++abs_spi_error_count_;
+                if (++abs_spi_bad_frames_ > kMaxBadFrames) {
+                    set_error(ERROR_ABS_SPI_COM_FAIL);
+                    return false;
+                }
+                meas_interpolation_ += current_meas_period * vel_estimate_;
+                break;
+            }
+            abs_spi_bad_frames_ = 0;
+            abs_spi_pos_ = raw_pos;
+
+            int32_t count;
+            abs_spi_pos_to_count(raw_pos, config_.cpr, &count, &meas_interpolation_);
+            float pos = (float)count + meas_interpolation_;
+
+            if (!abs_spi_pos_init_) {
+                // Start at the absolute position instead of tracking from 0
+                shadow_count_ = count;
+                count_in_cpr_ = count;
+                pos_estimate_ = pos;
+                pos_cpr_ = pos;
+                vel_estimate_ = 0.0f;
+                abs_spi_pos_init_ = true;
+            }
+
+            delta_enc = count - count_in_cpr_;
+            delta_enc = mod(delta_enc, config_.cpr);
+            if (delta_enc > config_.cpr / 2)
+                delta_enc -= config_.cpr;
+        } break;
+
         default: {
            set_error(ERROR_UNSUPPORTED_ENCODER_MODE);
            return false;
@@ -345,17 +599,62 @@ bool Encoder::update() {
     // Predict current pos
     pos_estimate_ += current_meas_period * vel_estimate_;
     pos_cpr_      += current_meas_period * vel_estimate_;
-    // discrete phase detector
-    float delta_pos     = (float)(shadow_count_ - (int32_t)floorf(pos_estimate_));
-    float delta_pos_cpr = (float)(count_in_cpr_ - (int32_t)floorf(pos_cpr_));
+    // Compensate the latency of the absolute SPI frames
+    float latency = 0.0f; // [s]
+    if (is_abs_spi_mode(config_.mode))
+        latency = abs_spi_latency_periods(config_.mode == MODE_SPI_ABS_AMS) * current_meas_period;
+    float meas_lead = latency * vel_estimate_; // [count]
+
+    bool measured_interpolation = config_.mode == MODE_SINCOS || is_abs_spi_mode(config_.mode);
+    float delta_pos, delta_pos_cpr;
+    if (measured_interpolation) {
+        // The position within the count is measured
+        delta_pos     = (float)shadow_count_ + meas_interpolation_ + meas_lead - pos_estimate_;
+        delta_pos_cpr = (float)count_in_cpr_ + meas_interpolation_ + meas_lead - pos_cpr_;
+    } else {
+        // discrete phase detector
+        delta_pos     = (float)(shadow_count_ - (int32_t)floorf(pos_estimate_));
+        delta_pos_cpr = (float)(count_in_cpr_ - (int32_t)floorf(pos_cpr_));
+    }
     delta_pos_cpr = wrap_pm(delta_pos_cpr, 0.5f * (float)(config_.cpr));
     // pll feedback
     pos_estimate_ += current_meas_period * pll_kp_ * delta_pos;
     pos_cpr_      += current_meas_period * pll_kp_ * delta_pos_cpr;
     pos_cpr_ = fmodf_pos(pos_cpr_, (float)(config_.cpr));
     vel_estimate_      += current_meas_period * pll_ki_ * delta_pos_cpr;
+
+    //// edge timing
+    // At low speed, the edges are too far apart for the PLL. Instead, the
+    // velocity comes from the time between edges and the position is
+    // extrapolated from the last edge. The PLL state follows this estimate,
+    // so it takes over smoothly between 0.5 and 1 times edge_timing_max_vel.
+    float edge_weight = 0.0f;
+    float edge_interpolation = 0.5f;
+    if (config_.enable_edge_timing && (config_.mode == MODE_INCREMENTAL || config_.mode == MODE_HALL)) {
+        static const float kEdgeTimeout = 1.0f; // [s] consider the rotor stopped after this
+        update_edge_timing(delta_enc);
+        float elapsed = ((float)(axis_->loop_counter_ - edge_loop_count_) + 0.5f) * current_meas_period;
+        if (edge_speed_ > 0.0f) {
+            // Without an edge for longer than one count at edge_speed_, the rotor is slowing down
+            float speed = std::min(edge_speed_, 1.0f / elapsed);
+            float fraction = std::min(elapsed * speed, 1.0f);
+            edge_interpolation = (edge_dir_ > 0) ? fraction : 1.0f - fraction;
+            edge_timing_vel_ = (elapsed < kEdgeTimeout) ? (float)edge_dir_ * speed : 0.0f;
+        } else {
+            edge_timing_vel_ = 0.0f;
+        }
+        if (config_.edge_timing_max_vel > 0.0f)
+            edge_weight = std::min(std::max(2.0f - 2.0f * fabsf(edge_timing_vel_) / config_.edge_timing_max_vel, 0.0f), 1.0f);
+        float edge_pos = (float)shadow_count_ + edge_interpolation;
+        float edge_pos_cpr = (float)count_in_cpr_ + edge_interpolation;
+        vel_estimate_ += edge_weight * (edge_timing_vel_ - vel_estimate_);
+        pos_estimate_ += edge_weight * (edge_pos - pos_estimate_);
+        pos_cpr_ += edge_weight * wrap_pm(edge_pos_cpr - pos_cpr_, 0.5f * (float)(config_.cpr));
+        pos_cpr_ = fmodf_pos(pos_cpr_, (float)(config_.cpr));
+    }
+
     bool snap_to_zero_vel = false;
-    if (fabsf(vel_estimate_) < 0.5f * current_meas_period * pll_ki_) {
+    if (edge_weight == 0.0f && fabsf(vel_estimate_) < 0.5f * current_meas_period * pll_ki_) {
         vel_estimate_ = 0.0f; //align delta-sigma on zero to prevent jitter
         snap_to_zero_vel = true;
     }
@@ -377,7 +676,11 @@ bool Encoder::update() {
         if (interpolation_ > 1.0f) interpolation_ = 1.0f;
         if (interpolation_ < 0.0f) interpolation_ = 0.0f;
     }
-    float interpolated_enc = corrected_enc + interpolation_;
+    if (config_.enable_phase_interpolation)
+        interpolation_ += edge_weight * (edge_interpolation - interpolation_);
+    if (measured_interpolation)
+        interpolation_ = meas_interpolation_;
+    float interpolated_enc = corrected_enc + interpolation_ + meas_lead;
 
     //// compute electrical phase
     //TODO avoid recomputing elec_rad_per_enc every time
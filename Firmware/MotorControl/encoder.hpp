@@ -15,12 +15,16 @@ public:
         ERROR_UNSUPPORTED_ENCODER_MODE = 0x08,
         ERROR_ILLEGAL_HALL_STATE = 0x10,
         ERROR_INDEX_NOT_FOUND_YET = 0x20,
+        ERROR_SINCOS_SIGNAL_OUT_OF_RANGE = 0x40,
+        ERROR_ABS_SPI_COM_FAIL = 0x80,
     };
 
     enum Mode_t {
         MODE_INCREMENTAL,
         MODE_HALL,
-        MODE_SINCOS
+        MODE_SINCOS,
+        MODE_SPI_ABS_CUI = 0x100, // CUI AMT23
+        MODE_SPI_ABS_AMS = 0x101  // AMS AS5047P, AS5048A
     };
 
     struct Config_t {
@@ -43,6 +47,19 @@ public:
         bool find_idx_on_lockin_only = false; // Only be sensitive during lockin scan constant vel state
         bool idx_search_unidirectional = false; // Only allow index search in known direction
         bool ignore_illegal_hall_state = false; // dont error on bad states like 000 or 111
+        bool enable_edge_timing = false; // Estimate low speeds from the time between edges (incremental and hall)
+        float edge_timing_max_vel = 200.0f; // [count/s] Hand over to the PLL up to this speed
+        float edge_timing_window = 0.002f; // [s] Minimum time over which the edges are counted
+        // SinCos: the cpr is divided evenly over the periods. The signal
+        // correction is measured by run_sincos_calibration.
+        // pre_calibrated is only honoured if sincos_periods is 1 or divides the
+        // motor's pole_pairs, because the starting period is unknown after boot.
+        int32_t sincos_periods = 1; // sin/cos periods per revolution
+        float sincos_offset_s = 0.0f; // [1] fraction of the ADC range
+        float sincos_offset_c = 0.0f; // [1] fraction of the ADC range
+        float sincos_gain_c = 1.0f; // amplitude of sin / amplitude of cos
+        float sincos_quadrature_error = 0.0f; // [rad] phase error of cos
+        uint16_t abs_spi_cs_gpio_pin = 1; // chip select of absolute SPI encoders
     };
 
     Encoder(const EncoderHardwareConfig_t& hw_config,
@@ -64,7 +81,13 @@ public:
     bool run_index_search();
     bool run_direction_find();
     bool run_offset_calibration();
+    bool run_sincos_calibration();
+    bool sincos_phase_is_absolute();
+    void abs_spi_cs_pin_init();
+    void abs_spi_start_transaction();
+    void abs_spi_cb(bool success);
     void sample_now();
+    void update_edge_timing(int32_t delta_enc);
     bool update();
 
 
@@ -87,11 +110,46 @@ public:
     float pll_ki_ = 0.0f;   // [(count/s^2) / count]
     float calib_scan_response_ = 0.0f; // debug report from offset calib
 
+    // Edge timing
+    uint32_t edge_loop_count_ = 0;      // loop count at the last edge
+    int32_t edge_dir_ = 0;              // direction of the last edge
+    uint32_t edge_window_loop_count_ = 0; // loop count at the first edge of the measurement window
+    int32_t edge_window_count_ = 0;     // shadow count at the first edge of the measurement window
+    float edge_speed_ = 0.0f;           // [count/s] of the last window (0: unknown)
+    float edge_timing_vel_ = 0.0f;      // [count/s]
+
     int16_t tim_cnt_sample_ = 0; // 
     // Updated by low_level pwm_adc_cb
     uint8_t hall_state_ = 0x0; // bit[0] = HallA, .., bit[2] = HallC
     float sincos_sample_s_ = 0.0f;
     float sincos_sample_c_ = 0.0f;
+    int32_t sincos_period_ = 0;         // period within the revolution
+    float sincos_fraction_ = 0.0f;      // [1] position within the period
+    float meas_interpolation_ = 0.0f;   // [count] position within the count (sincos and absolute SPI)
+    float sincos_amplitude_ = 0.0f;     // [1] corrected signal amplitude
+
+    // SinCos calibration (see run_sincos_calibration())
+    struct SincosCalibration_t {
+        float s_sum, c_sum;
+        float ss_sum, cc_sum, sc_sum;
+        uint32_t samples;
+    };
+    SincosCalibration_t sincos_calib_ = {};
+    bool sincos_calib_active_ = false;
+
+    // Absolute SPI encoders (see abs_spi_start_transaction())
+    GPIO_TypeDef* abs_spi_cs_port_ = nullptr;
+    uint16_t abs_spi_cs_pin_ = 0;
+    uint16_t abs_spi_dma_tx_[1] = {0};
+    uint16_t abs_spi_dma_rx_[1] = {0};
+    volatile bool abs_spi_dma_busy_ = false; // transaction in progress
+    volatile bool abs_spi_dma_done_ = false; // abs_spi_dma_rx_ holds a complete frame
+    uint16_t abs_spi_frame_ = 0;             // frame handed over to update()
+    bool abs_spi_frame_valid_ = false;
+    bool abs_spi_pos_init_ = false;          // the count was set from the first valid frame
+    uint16_t abs_spi_pos_ = 0;               // [1/2^14 rev] last valid position
+    uint32_t abs_spi_bad_frames_ = 0;        // consecutive missing or corrupted frames
+    uint32_t abs_spi_error_count_ = 0;       // total missing or corrupted frames
 
     // Communication protocol definitions
     auto make_protocol_definitions() {
@@ -106,8 +164,12 @@ public:
             make_protocol_property("pos_estimate", &pos_estimate_),
             make_protocol_property("pos_cpr", &pos_cpr_),
             make_protocol_ro_property("hall_state", &hall_state_),
+            make_protocol_ro_property("edge_timing_vel", &edge_timing_vel_),
             make_protocol_property("vel_estimate", &vel_estimate_),
             make_protocol_ro_property("calib_scan_response", &calib_scan_response_),
+            make_protocol_ro_property("sincos_amplitude", &sincos_amplitude_),
+            make_protocol_ro_property("abs_spi_pos", &abs_spi_pos_),
+            make_protocol_ro_property("abs_spi_error_count", &abs_spi_error_count_),
             // make_protocol_property("pll_kp", &pll_kp_),
             // make_protocol_property("pll_ki", &pll_ki_),
             make_protocol_object("config",
@@ -129,7 +191,17 @@ public:
                 make_protocol_property("calib_scan_distance", &config_.calib_scan_distance),
                 make_protocol_property("calib_scan_omega", &config_.calib_scan_omega),
                 make_protocol_property("idx_search_unidirectional", &config_.idx_search_unidirectional),
-                make_protocol_property("ignore_illegal_hall_state", &config_.ignore_illegal_hall_state)
+                make_protocol_property("ignore_illegal_hall_state", &config_.ignore_illegal_hall_state),
+                make_protocol_property("enable_edge_timing", &config_.enable_edge_timing),
+                make_protocol_property("edge_timing_max_vel", &config_.edge_timing_max_vel),
+                make_protocol_property("edge_timing_window", &config_.edge_timing_window),
+                make_protocol_property("sincos_periods", &config_.sincos_periods),
+                make_protocol_property("sincos_offset_s", &config_.sincos_offset_s),
+                make_protocol_property("sincos_offset_c", &config_.sincos_offset_c),
+                make_protocol_property("sincos_gain_c", &config_.sincos_gain_c),
+                make_protocol_property("sincos_quadrature_error", &config_.sincos_quadrature_error),
+                make_protocol_property("abs_spi_cs_gpio_pin", &config_.abs_spi_cs_gpio_pin,
+                    [](void* ctx) { static_cast<Encoder*>(ctx)->abs_spi_cs_pin_init(); }, this)
             ),
             make_protocol_function("set_linear_count", *this, &Encoder::set_linear_count, "count")
         );
@@ -0,0 +1,117 @@
+
+#include <math.h>
+#include "odrive_main.h"
+
+// Rate at which analog inputs are mapped onto their endpoints
+static constexpr float ANALOG_MAPPING_UPDATE_HZ = 1000.0f;
+
+InputMapping pwm_input_mappings[GPIO_COUNT];
+InputMapping analog_input_mappings[GPIO_COUNT];
+
+// @brief Binds all mappings to their configs and resolves the endpoints.
+// Must be called after the communication is initialized.
+void init_input_mappings() {
+    for (size_t i = 0; i < GPIO_COUNT; ++i) {
+        pwm_input_mappings[i].bind(&board_config.pwm_mappings[i]);
+        analog_input_mappings[i].bind(&board_config.analog_mappings[i]);
+    }
+}
+
+// @brief Samples the analog inputs and updates the mapped endpoints.
+// Called whenever new ADC measurements are available and decimated
+// to ANALOG_MAPPING_UPDATE_HZ.
+// @param dt: time since the previous call [s]
+void update_analog_input_mappings(float dt) {
+    static float elapsed = 0.0f;
+    elapsed += dt;
+    if (elapsed < 1.0f / ANALOG_MAPPING_UPDATE_HZ)
+        return;
+    dt = elapsed;
+    elapsed = 0.0f;
+
+    for (size_t i = 0; i < GPIO_COUNT; ++i) {
+        InputMapping& mapping = analog_input_mappings[i];
+        if (!mapping.is_active())
+            continue;
+        int gpio_num = i + 1;
+        float voltage = get_adc_voltage(get_gpio_port_by_pin(gpio_num), get_gpio_pin_by_pin(gpio_num));
+        mapping.update(voltage / adc_ref_voltage, dt);
+    }
+}
+
+void InputMapping::bind(PWMMapping_t* config) {
+    config_ = config;
+    resolve_endpoint();
+}
+
+// @brief Looks up the endpoint of the current config.
+// Called whenever config_->endpoint is written.
+// The endpoint is written from interrupt context, so anything other than a
+// plain float property (e.g. a property with a write hook) is not mapped.
+void InputMapping::resolve_endpoint() {
+    if (!config_)
+        return;
+    Endpoint* endpoint = get_endpoint(config_->endpoint);
+    if (endpoint && !endpoint->is_plain_float())
+        endpoint = nullptr;
+    uint32_t mask = cpu_enter_critical();
+    endpoint_ = endpoint;
+    reset();
+    cpu_exit_critical(mask);
+}
+
+void InputMapping::reset() {
+    n_samples_ = 0;
+}
+
+// @brief Processes a new input sample and writes the result to the endpoint.
+// @param fraction: input normalized to [0, 1] over the input range
+// @param dt: time since the previous sample [s]
+void InputMapping::update(float fraction, float dt) {
+    Endpoint* endpoint = endpoint_;
+    if (!endpoint)
+        return;
+    const PWMMapping_t& config = *config_;
+
+    fraction = std::min(std::max(fraction, 0.0f), 1.0f);
+    bool first_sample = (n_samples_ == 0);
+
+    // Median of the last 3 samples
+    if (config.median_filter) {
+        if (first_sample)
+            samples_[1] = samples_[2] = fraction;
+        samples_[0] = samples_[1];
+        samples_[1] = samples_[2];
+        samples_[2] = fraction;
+        float a = samples_[0], b = samples_[1], c = samples_[2];
+        fraction = std::max(std::min(a, b), std::min(std::max(a, b), c));
+    }
+    n_samples_ = 1;
+
+    // Deadband around the center. The remaining range is stretched such
+    // that the ends of the input range still map to min and max.
+    if (config.deadband > 0.0f && config.deadband < 1.0f) {
+        float offset = fraction - 0.5f;
+        float magnitude = std::max(fabsf(offset) - 0.5f * config.deadband, 0.0f) / (1.0f - config.deadband);
+        fraction = 0.5f + (offset < 0.0f ? -magnitude : magnitude);
+    }
+
+    // First order low-pass filter
+    if (first_sample || config.filter_bandwidth <= 0.0f) {
+        filtered_ = fraction;
+    } else {
+        float k = std::min(2.0f * M_PI * config.filter_bandwidth * dt, 1.0f);
+        filtered_ += k * (fraction - filtered_);
+    }
+
+    float value = config.min + filtered_ * (config.max - config.min);
+
+    // Rate limiter
+    if (!first_sample && config.rate_limit > 0.0f) {
+        float max_step = config.rate_limit * dt;
+        value = std::min(std::max(value, value_ - max_step), value_ + max_step);
+    }
+
+    value_ = value;
+    endpoint->set_from_float(value);
+}
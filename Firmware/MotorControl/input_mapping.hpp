@@ -0,0 +1,45 @@
+#ifndef __INPUT_MAPPING_HPP
+#define __INPUT_MAPPING_HPP
+
+#ifndef __ODRIVE_MAIN_H
+#error "This file should not be included directly. Include odrive_main.h instead."
+#endif
+
+// @brief Maps an RC PWM or analog input onto an endpoint, such as a
+// controller setpoint.
+//
+// The input is passed through a chain of optional stages:
+// median filter -> deadband -> low-pass filter -> scaling -> rate limiter.
+// update() is called from interrupt context whenever a new sample is
+// available (on each RC PWM pulse, or at a fixed rate from the ADC interrupt
+// for analog inputs).
+//
+// The target endpoint is resolved when the mapping is bound and whenever
+// the endpoint config is written, so that update() doesn't need to look it up.
+// Only float properties without write hook can be mapped.
+class InputMapping {
+public:
+    void bind(PWMMapping_t* config);
+    void resolve_endpoint();
+    void update(float fraction, float dt);
+    bool is_active() { return endpoint_ != nullptr; }
+
+    PWMMapping_t* config_ = nullptr;
+    Endpoint* volatile endpoint_ = nullptr;
+    float value_ = 0.0f; // last value written to the endpoint
+
+private:
+    void reset();
+
+    float samples_[3];
+    size_t n_samples_ = 0;
+    float filtered_ = 0.0f;
+};
+
+extern InputMapping pwm_input_mappings[GPIO_COUNT];
+extern InputMapping analog_input_mappings[GPIO_COUNT];
+
+void init_input_mappings();
+void update_analog_input_mappings(float dt);
+
+#endif // __INPUT_MAPPING_HPP
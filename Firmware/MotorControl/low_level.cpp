@@ -36,6 +36,9 @@ const float adc_ref_voltage = 3.3f;
 // Arbitrary non-zero inital value to avoid division by zero if ADC reading is late
 float vbus_voltage = 12.0f;
 bool brake_resistor_armed = false;
+// Regenerative bus current that the motors may feed into the DC bus in total [A]
+// This is updated by update_brake_current().
+float regen_current_allowed = INFINITY;
 /* Private constant data -----------------------------------------------------*/
 static const GPIO_TypeDef* GPIOs_to_samp[] = { GPIOA, GPIOB, GPIOC };
 static const int num_GPIO = sizeof(GPIOs_to_samp) / sizeof(GPIOs_to_samp[0]); 
@@ -311,15 +314,26 @@ void sync_timers(TIM_HandleTypeDef* htim_a, TIM_HandleTypeDef* htim_b,
     htim_b->Instance->BDTR |= MOE_store_b;
 }
 
-// @brief ADC1 measurements are written to this buffer by DMA
-uint16_t adc_measurements_[ADC_CHANNEL_COUNT] = { 0 };
+// @brief Raw ADC1 measurements are written to this buffer by DMA.
+// The DMA runs in circular mode over both halves of the buffer. While one
+// half is being written, the other half is decimated into adc_measurements_.
+static uint16_t adc_dma_buffer_[2][ADC_OVERSAMPLING][ADC_CHANNEL_COUNT];
+
+// @brief Filtered ADC1 measurements [ADC counts]
+float adc_measurements_[ADC_CHANNEL_COUNT] = { 0 };
+
+// @brief Time of the last update of adc_measurements_ [us]
+uint32_t adc_timestamp_ = 0;
 
 // @brief Starts the general purpose ADC on the ADC1 peripheral.
 // The measured ADC voltages can be read with get_adc_voltage().
 //
 // ADC1 is set up to continuously sample all channels 0 to 15 in a
 // round-robin fashion.
-// DMA is used to copy the measured 12-bit values to adc_measurements_.
+// DMA is used to copy the measured 12-bit values to adc_dma_buffer_. Each
+// half of the buffer holds ADC_OVERSAMPLING samples of every channel. The
+// DMA half/complete interrupts average these samples and pass them through
+// a per-channel low-pass filter (see adc_dma_cb).
 //
 // The injected (high priority) channel of ADC1 is used to sample vbus_voltage.
 // This conversion is triggered by TIM1 at the frequency of the motor control loop.
@@ -353,27 +367,51 @@ void start_general_purpose_adc() {
             _Error_Handler((char*)__FILE__, __LINE__);
     }
 
-    HAL_ADC_Start_DMA(&hadc1, reinterpret_cast<uint32_t*>(adc_measurements_), ADC_CHANNEL_COUNT);
+    adc_timestamp_ = micros();
+    HAL_ADC_Start_DMA(&hadc1, reinterpret_cast<uint32_t*>(adc_dma_buffer_),
+                      sizeof(adc_dma_buffer_) / sizeof(adc_dma_buffer_[0][0][0]));
 }
 
-// @brief Returns the ADC voltage associated with the specified pin.
-// GPIO_set_to_analog() must be called first to put the Pin into
-// analog mode.
-// Returns NaN if the pin has no associated ADC1 channel.
-//
-// On ODrive 3.3 and 3.4 the following pins can be used with this function:
-//  GPIO_1, GPIO_2, GPIO_3, GPIO_4 and some pins that are connected to
-//  on-board sensors (M0_TEMP, M1_TEMP, AUX_TEMP)
-//
-// The ADC values are sampled in background at ~30kHz without
-// any CPU involvement.
-//
-// Details: each of the 16 conversion takes (15+26) ADC clock
-// cycles and the ADC, so the update rate of the entire sequence is:
-//  21000kHz / (15+26) / 16 = 32kHz
-// The true frequency is slightly lower because of the injected vbus
-// measurements
-float get_adc_voltage(GPIO_TypeDef* GPIO_port, uint16_t GPIO_pin) {
+// @brief Decimates one half of the DMA buffer into adc_measurements_.
+// Called from the DMA half transfer and transfer complete interrupts.
+static void adc_dma_cb(size_t half) {
+    uint32_t now = micros();
+    float dt = (float)(now - adc_timestamp_) * 1e-6f;
+
+    for (size_t channel = 0; channel < ADC_CHANNEL_COUNT; ++channel) {
+        // Moving average over the oversampled measurements
+        uint32_t sum = 0;
+        for (size_t i = 0; i < ADC_OVERSAMPLING; ++i)
+            sum += adc_dma_buffer_[half][i][channel];
+        float value = (float)sum * (1.0f / ADC_OVERSAMPLING);
+
+        // First order low-pass filter
+        float bandwidth = board_config.adc_filter_bandwidth[channel];
+        if (bandwidth > 0.0f) {
+            float k = std::min(2.0f * M_PI * bandwidth * dt, 1.0f);
+            adc_measurements_[channel] += k * (value - adc_measurements_[channel]);
+        } else {
+            adc_measurements_[channel] = value;
+        }
+    }
+
+    adc_timestamp_ = now;
+    update_analog_input_mappings(dt);
+}
+
+extern "C" void HAL_ADC_ConvHalfCpltCallback(ADC_HandleTypeDef* hadc) {
+    if (hadc == &hadc1)
+        adc_dma_cb(0);
+}
+
+extern "C" void HAL_ADC_ConvCpltCallback(ADC_HandleTypeDef* hadc) {
+    if (hadc == &hadc1)
+        adc_dma_cb(1);
+}
+
+// @brief Returns the ADC1 channel associated with the specified pin, or
+// UINT32_MAX if the pin has no associated ADC1 channel.
+uint32_t get_adc_channel(GPIO_TypeDef* GPIO_port, uint16_t GPIO_pin) {
     uint32_t channel = UINT32_MAX;
     if (GPIO_port == GPIOA) {
         if (GPIO_pin == GPIO_PIN_0)
@@ -411,8 +449,30 @@ float get_adc_voltage(GPIO_TypeDef* GPIO_port, uint16_t GPIO_pin) {
         else if (GPIO_pin == GPIO_PIN_5)
             channel = 15;
     }
+    return channel;
+}
+
+// @brief Returns the filtered ADC voltage associated with the specified pin.
+// GPIO_set_to_analog() must be called first to put the Pin into
+// analog mode.
+// Returns NaN if the pin has no associated ADC1 channel.
+//
+// On ODrive 3.3 and 3.4 the following pins can be used with this function:
+//  GPIO_1, GPIO_2, GPIO_3, GPIO_4 and some pins that are connected to
+//  on-board sensors (M0_TEMP, M1_TEMP, AUX_TEMP)
+//
+// The ADC values are sampled in background at ~30kHz without
+// any CPU involvement. The filtered values are updated at ~30kHz / ADC_OVERSAMPLING.
+//
+// Details: each of the 16 conversion takes (15+26) ADC clock
+// cycles and the ADC, so the update rate of the entire sequence is:
+//  21000kHz / (15+26) / 16 = 32kHz
+// The true frequency is slightly lower because of the injected vbus
+// measurements
+float get_adc_voltage(GPIO_TypeDef* GPIO_port, uint16_t GPIO_pin) {
+    uint32_t channel = get_adc_channel(GPIO_port, GPIO_pin);
     if (channel < ADC_CHANNEL_COUNT)
-        return ((float)adc_measurements_[channel]) * (adc_ref_voltage / adc_full_scale);
+        return adc_measurements_[channel] * (adc_ref_voltage / adc_full_scale);
     else
         return 0.0f / 0.0f; // NaN
 }
@@ -508,9 +568,15 @@ void pwm_trig_adc_cb(ADC_HandleTypeDef* hadc, bool injected) {
                 other_axis.motor_.error_ |= Motor::ERROR_CONTROL_DEADLINE_MISSED;
             }
         } else {
-            other_axis.motor_.next_timings_valid_ = false;
+            Motor& other_motor = other_axis.motor_;
+            other_motor.next_timings_valid_ = false;
+            // The next current and DC calibration samples may see the old or the new timings
+            other_motor.dc_calib_allowed_ = other_motor.applied_timings_allow_dc_calib_ && other_motor.next_timings_allow_dc_calib_;
+            other_motor.applied_timings_allow_dc_calib_ = other_motor.next_timings_allow_dc_calib_;
+            other_motor.current_meas_allowed_ = other_motor.applied_timings_current_meas_ & other_motor.next_timings_current_meas_;
+            other_motor.applied_timings_current_meas_ = other_motor.next_timings_current_meas_;
             safety_critical_apply_motor_pwm_timings(
-                other_axis.motor_, other_axis.motor_.next_timings_
+                other_motor, other_motor.next_timings_
             );
         }
         update_brake_current();
@@ -534,6 +600,8 @@ void pwm_trig_adc_cb(ADC_HandleTypeDef* hadc, bool injected) {
         // return or continue
         if (hadc == &hadc2) {
             axis.motor_.current_meas_.phB = current - axis.motor_.DC_calib_.phB;
+            axis.motor_.current_meas_valid_ = (axis.motor_.armed_state_ == Motor::ARMED_STATE_ARMED)
+                    ? axis.motor_.current_meas_allowed_ : Motor::CURRENT_MEAS_ALL;
             return;
         } else {
             axis.motor_.current_meas_.phC = current - axis.motor_.DC_calib_.phC;
@@ -543,8 +611,10 @@ void pwm_trig_adc_cb(ADC_HandleTypeDef* hadc, bool injected) {
         decode_hall_samples(axis.encoder_, GPIO_port_samples[axis_num]);
         // Trigger axis thread
         axis.signal_current_meas();
-    } else {
+    } else if (axis.motor_.armed_state_ != Motor::ARMED_STATE_ARMED || axis.motor_.dc_calib_allowed_) {
         // DC_CAL measurement
+        // Skipped while discontinuous PWM clamps phase B or C low, because
+        // the shunt then carries the phase current.
         if (hadc == &hadc2) {
             axis.motor_.DC_calib_.phB += (current - axis.motor_.DC_calib_.phB) * calib_filter_k;
         } else {
@@ -581,8 +651,70 @@ void tim_update_cb(TIM_HandleTypeDef* htim) {
     }
 }
 
+// SPI3 is shared by the gate drivers and the absolute SPI encoders. A gate
+// driver access is a sequence of blocking transfers with nCS pulsed in
+// between, so it claims the bus for the whole sequence. The encoders start
+// their DMA transfers from the timer interrupt and skip them while the bus
+// is claimed (see Encoder::abs_spi_start_transaction()).
+static volatile uint32_t gate_driver_spi_claims = 0;
+
+// @brief Claims the bus for a gate driver access. Waits for an encoder
+// transfer that is in flight and restores the baud rate of the bus, which the
+// encoders adjust to their own clock limit.
+void gate_driver_spi_claim(SPI_HandleTypeDef* hspi) {
+    uint32_t mask = cpu_enter_critical();
+    gate_driver_spi_claims++;
+    cpu_exit_critical(mask);
+
+    // An encoder transfer takes a few microseconds
+    uint32_t start = HAL_GetTick();
+    while (hspi->State != HAL_SPI_STATE_READY && HAL_GetTick() - start < 2);
+
+    if ((hspi->Instance->CR1 & SPI_CR1_BR) != hspi->Init.BaudRatePrescaler) {
+        __HAL_SPI_DISABLE(hspi);
+        MODIFY_REG(hspi->Instance->CR1, SPI_CR1_BR, hspi->Init.BaudRatePrescaler);
+    }
+}
+
+void gate_driver_spi_release() {
+    uint32_t mask = cpu_enter_critical();
+    gate_driver_spi_claims--;
+    cpu_exit_critical(mask);
+}
+
+bool gate_driver_spi_claimed() {
+    return gate_driver_spi_claims != 0;
+}
+
+// Absolute SPI encoder transactions (see Encoder::abs_spi_start_transaction())
+static void abs_spi_dma_cb(SPI_HandleTypeDef* hspi, bool success) {
+    for (size_t i = 0; i < AXIS_COUNT; ++i) {
+        Encoder& encoder = axes[i]->encoder_;
+        if (encoder.hw_config_.spi == hspi && encoder.abs_spi_dma_busy_)
+            encoder.abs_spi_cb(success);
+    }
+}
+
+extern "C" void HAL_SPI_TxRxCpltCallback(SPI_HandleTypeDef* hspi) {
+    abs_spi_dma_cb(hspi, true);
+}
+
+extern "C" void HAL_SPI_ErrorCallback(SPI_HandleTypeDef* hspi) {
+    abs_spi_dma_cb(hspi, false);
+}
+
 // @brief Sums up the Ibus contribution of each motor and updates the
 // brake resistor PWM accordingly.
+//
+// If DC bus voltage regulation is enabled, this also updates the regenerative
+// current budget of the motors (regen_current_allowed). The budget is what the
+// brake resistor and the power supply can absorb (the feedforward), plus a
+// margin that shrinks linearly to zero as vbus_voltage rises from
+// dc_bus_overvoltage_ramp_start to dc_bus_overvoltage_ramp_end. Below the ramp
+// the full budget applies. Over the same range the brake duty is ramped up, so
+// that the resistor also absorbs power that wasn't predicted.
+// If the ramp is empty or inverted, the margin is zero and both switch at
+// dc_bus_overvoltage_ramp_start.
 void update_brake_current() {
     float Ibus_sum = 0.0f;
     for (size_t i = 0; i < AXIS_COUNT; ++i) {
@@ -590,11 +722,41 @@ void update_brake_current() {
             Ibus_sum += axes[i]->motor_.current_control_.Ibus;
         }
     }
-    float brake_current = -Ibus_sum;
+    // The power supply takes up to max_regen_current, the brake resistor takes the rest
+    float brake_current = -Ibus_sum - board_config.max_regen_current;
     // Clip negative values to 0.0f
     if (brake_current < 0.0f) brake_current = 0.0f;
     float brake_duty = brake_current * board_config.brake_resistance / vbus_voltage;
 
+    if (board_config.enable_dc_bus_voltage_regulation) {
+        const float ramp_start = board_config.dc_bus_overvoltage_ramp_start;
+        float ramp_width = board_config.dc_bus_overvoltage_ramp_end - ramp_start;
+        if (!(ramp_width > 0.0f))
+            ramp_width = 0.0f; // also catches NaN
+        float ramp;
+        if (ramp_width > 0.0f)
+            ramp = std::min(std::max((vbus_voltage - ramp_start) / ramp_width, 0.0f), 1.0f);
+        else
+            ramp = (vbus_voltage >= ramp_start) ? 1.0f : 0.0f;
+
+        bool has_brake_resistor = board_config.brake_resistance > 0.0f;
+        float brake_capacity = has_brake_resistor ? 0.9f * vbus_voltage / board_config.brake_resistance : 0.0f;
+        float regen_capacity = board_config.max_regen_current + brake_capacity;
+        regen_current_allowed = (1.0f - ramp) *
+            (regen_capacity + board_config.dc_bus_voltage_regulation_gain * ramp_width);
+
+        if (has_brake_resistor)
+            brake_duty = std::max(brake_duty, 0.9f * ramp);
+
+        // The regen limit of the motors takes care of the excess power, so
+        // saturating the brake resistor is not an error.
+        // If brake_duty is NaN, this expression is false and we fault below.
+        if (brake_duty > 0.9f)
+            brake_duty = 0.9f;
+    } else {
+        regen_current_allowed = INFINITY;
+    }
+
     // Duty limit at 90% to allow bootstrap caps to charge
     // If brake_duty is NaN, this expression will also evaluate to false
     if ((brake_duty >= 0.0f) && (brake_duty <= 0.9f)) {
@@ -688,7 +850,7 @@ void pwm_in_init() {
 #define PWM_MAX_LEGAL_HIGH_TIME    ((TIM_2_5_CLOCK_HZ / 1000000UL) * 2500UL) // ignore high periods longer than 2.5ms
 #define PWM_INVERT_INPUT        false
 
-void handle_pulse(int gpio_num, uint32_t high_time) {
+void handle_pulse(int gpio_num, uint32_t high_time, float dt) {
     if (high_time < PWM_MIN_LEGAL_HIGH_TIME || high_time > PWM_MAX_LEGAL_HIGH_TIME)
         return;
 
@@ -697,18 +859,12 @@ void handle_pulse(int gpio_num, uint32_t high_time) {
     if (high_time > PWM_MAX_HIGH_TIME)
         high_time = PWM_MAX_HIGH_TIME;
     float fraction = (float)(high_time - PWM_MIN_HIGH_TIME) / (float)(PWM_MAX_HIGH_TIME - PWM_MIN_HIGH_TIME);
-    float value = board_config.pwm_mappings[gpio_num - 1].min +
-                  (fraction * (board_config.pwm_mappings[gpio_num - 1].max - board_config.pwm_mappings[gpio_num - 1].min));
-
-    Endpoint* endpoint = get_endpoint(board_config.pwm_mappings[gpio_num - 1].endpoint);
-    if (!endpoint)
-        return;
-
-    endpoint->set_from_float(value);
+    pwm_input_mappings[gpio_num - 1].update(fraction, dt);
 }
 
 void pwm_in_cb(int channel, uint32_t timestamp) {
     static uint32_t last_timestamp[GPIO_COUNT] = { 0 };
+    static uint32_t last_pulse_end[GPIO_COUNT] = { 0 };
     static bool last_pin_state[GPIO_COUNT] = { false };
     static bool last_sample_valid[GPIO_COUNT] = { false };
 
@@ -720,39 +876,13 @@ void pwm_in_cb(int channel, uint32_t timestamp) {
     if (last_sample_valid[gpio_num - 1]
         && (last_pin_state[gpio_num - 1] != PWM_INVERT_INPUT)
         && (current_pin_state == PWM_INVERT_INPUT)) {
-        handle_pulse(gpio_num, timestamp - last_timestamp[gpio_num - 1]);
+        // The time between two pulses is used as the sample period of the input filters
+        float dt = (float)(timestamp - last_pulse_end[gpio_num - 1]) / (float)TIM_2_5_CLOCK_HZ;
+        last_pulse_end[gpio_num - 1] = timestamp;
+        handle_pulse(gpio_num, timestamp - last_timestamp[gpio_num - 1], dt);
     }
 
     last_timestamp[gpio_num - 1] = timestamp;
     last_pin_state[gpio_num - 1] = current_pin_state;
     last_sample_valid[gpio_num - 1] = true;
 }
-
-
-/* Analog speed control input */
-
-static void update_analog_endpoint(const struct PWMMapping_t *map, int gpio)
-{
-    float fraction = get_adc_voltage(get_gpio_port_by_pin(gpio), get_gpio_pin_by_pin(gpio)) / 3.3f;
-    float value = map->min + (fraction * (map->max - map->min));
-    get_endpoint(map->endpoint)->set_from_float(value);
-}
-
-static void analog_polling_thread(void *)
-{
-    while (true) {
-        for (int i = 0; i < GPIO_COUNT; i++) {
-            struct PWMMapping_t *map = &board_config.analog_mappings[i];
-
-            if (is_endpoint_ref_valid(map->endpoint))
-                update_analog_endpoint(map, i + 1);
-        }
-        osDelay(10);
-    }
-}
-
-void start_analog_thread()
-{
-    osThreadDef(thread_def, analog_polling_thread, osPriorityLow, 0, 4*512);
-    osThreadCreate(osThread(thread_def), NULL);
-}
@@ -17,13 +17,15 @@ extern "C" {
 
 /* Exported types ------------------------------------------------------------*/
 /* Exported constants --------------------------------------------------------*/
-#define ADC_CHANNEL_COUNT 16
+#define ADC_OVERSAMPLING 4 // number of samples per channel that are averaged in each DMA half transfer
 extern const float adc_full_scale;
 extern const float adc_ref_voltage;
 /* Exported variables --------------------------------------------------------*/
 extern float vbus_voltage;
 extern bool brake_resistor_armed;
-extern uint16_t adc_measurements_[ADC_CHANNEL_COUNT];
+extern float regen_current_allowed;
+extern float adc_measurements_[ADC_CHANNEL_COUNT];
+extern uint32_t adc_timestamp_;
 /* Exported macro ------------------------------------------------------------*/
 /* Exported functions --------------------------------------------------------*/
 
@@ -50,11 +52,15 @@ void sync_timers(TIM_HandleTypeDef* htim_a, TIM_HandleTypeDef* htim_b,
                  TIM_HandleTypeDef* htim_refbase = nullptr);
 void start_general_purpose_adc();
 float get_adc_voltage(GPIO_TypeDef* GPIO_port, uint16_t GPIO_pin);
+uint32_t get_adc_channel(GPIO_TypeDef* GPIO_port, uint16_t GPIO_pin);
 void pwm_in_init();
-void start_analog_thread();
 
 void update_brake_current();
 
+void gate_driver_spi_claim(SPI_HandleTypeDef* hspi);
+void gate_driver_spi_release();
+bool gate_driver_spi_claimed();
+
 inline uint32_t cpu_enter_critical() {
     uint32_t primask = __get_PRIMASK();
     __disable_irq();
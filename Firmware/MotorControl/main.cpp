@@ -15,11 +15,13 @@ Controller::Config_t controller_configs[AXIS_COUNT];
 Motor::Config_t motor_configs[AXIS_COUNT];
 Axis::Config_t axis_configs[AXIS_COUNT];
 TrapezoidalTrajectory::Config_t trap_configs[AXIS_COUNT];
+MotionPlanner::Config_t motion_planner_config;
 bool user_config_loaded_;
 
 SystemStats_t system_stats_ = { 0 };
 
 Axis *axes[AXIS_COUNT];
+MotionPlanner *motion_planner;
 
 typedef Config<
     BoardConfig_t,
@@ -28,7 +30,8 @@ typedef Config<
     Controller::Config_t[AXIS_COUNT],
     Motor::Config_t[AXIS_COUNT],
     TrapezoidalTrajectory::Config_t[AXIS_COUNT],
-    Axis::Config_t[AXIS_COUNT]> ConfigFormat;
+    Axis::Config_t[AXIS_COUNT],
+    MotionPlanner::Config_t> ConfigFormat;
 
 void save_configuration(void) {
     if (ConfigFormat::safe_store_config(
@@ -38,7 +41,8 @@ void save_configuration(void) {
             &controller_configs,
             &motor_configs,
             &trap_configs,
-            &axis_configs)) {
+            &axis_configs,
+            &motion_planner_config)) {
         //printf("saving configuration failed\r\n"); osDelay(5);
     } else {
         user_config_loaded_ = true;
@@ -55,9 +59,11 @@ extern "C" int load_configuration(void) {
                 &controller_configs,
                 &motor_configs,
                 &trap_configs,
-                &axis_configs)) {
+                &axis_configs,
+                &motion_planner_config)) {
         //If loading failed, restore defaults
         board_config = BoardConfig_t();
+        motion_planner_config = MotionPlanner::Config_t();
         for (size_t i = 0; i < AXIS_COUNT; ++i) {
             encoder_configs[i] = Encoder::Config_t();
             sensorless_configs[i] = SensorlessEstimator::Config_t();
@@ -172,6 +178,7 @@ int odrive_main(void) {
         axes[i] = new Axis(i, hw_configs[i].axis_config, axis_configs[i],
                 *encoder, *sensorless_estimator, *controller, *motor, *trap);
     }
+    motion_planner = new MotionPlanner(motion_planner_config);
     
     // Start ADC for temperature measurements and user measurements
     start_general_purpose_adc();
@@ -186,6 +193,10 @@ int odrive_main(void) {
     // Init communications (this requires the axis objects to be constructed)
     init_communication();
 
+    // Resolve the endpoints of the PWM and analog input mappings
+    // must happen after communication is initialized
+    init_input_mappings();
+
     // Start pwm-in compare modules
     // must happen after communication is initialized
     pwm_in_init();
@@ -212,8 +223,7 @@ int odrive_main(void) {
     for (size_t i = 0; i < AXIS_COUNT; ++i) {
         axes[i]->start_thread();
     }
-
-    start_analog_thread();
+    motion_planner->start_thread();
 
     system_stats_.fully_booted = true;
     return 0;
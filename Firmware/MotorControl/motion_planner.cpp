@@ -0,0 +1,199 @@
+
+#include <math.h>
+#include <cmath>
+#include "odrive_main.h"
+#include "utils.h"
+
+MotionPlanner::MotionPlanner(Config_t& config) : config_(config) {}
+
+// @brief Appends a block to the end of the queue.
+// Can be called from several threads.
+// @returns false if the queue is full
+bool MotionPlanner::enqueue(const Block_t& block) {
+    bool success = false;
+    uint32_t mask = cpu_enter_critical();
+    size_t next_head = (queue_head_ + 1) % QUEUE_SIZE;
+    if (next_head != queue_tail_) {
+        queue_[queue_head_] = block;
+        queue_head_ = next_head; // publish the block only after it was written
+        success = true;
+    }
+    cpu_exit_critical(mask);
+    return success;
+}
+
+// @brief Returns the number of blocks that can be enqueued before the queue is full
+uint32_t MotionPlanner::get_free_space() {
+    return (queue_tail_ + QUEUE_SIZE - queue_head_ - 1) % QUEUE_SIZE;
+}
+
+// @brief Discards all queued blocks and clears the errors.
+// A move that is already running is completed.
+void MotionPlanner::clear() {
+    clear_requested_ = true;
+}
+
+static void run_planner_loop_wrapper(void* ctx) {
+    reinterpret_cast<MotionPlanner*>(ctx)->run_planner_loop();
+}
+
+void MotionPlanner::start_thread() {
+    osThreadDef(thread_def, run_planner_loop_wrapper, osPriorityNormal, 0, 512);
+    thread_id_ = osThreadCreate(osThread(thread_def), this);
+}
+
+void MotionPlanner::run_planner_loop() {
+    for (;;) {
+        if (clear_requested_) {
+            queue_tail_ = queue_head_;
+            error_ = ERROR_NONE;
+            clear_requested_ = false;
+        }
+
+        if (queue_tail_ == queue_head_ || error_ != ERROR_NONE) {
+            busy_ = false;
+            osDelay(1);
+            continue;
+        }
+        busy_ = true;
+
+        const Block_t& block = queue_[queue_tail_];
+        bool success = true;
+        switch (block.type) {
+            case BLOCK_TYPE_MOVE: success = execute_move(block); break;
+            case BLOCK_TYPE_DWELL: osDelay(block.dwell_ms); break;
+            case BLOCK_TYPE_ENABLE: success = enable_axes(); break;
+            case BLOCK_TYPE_DISABLE: disable_axes(); break;
+        }
+
+        // On failure the block stays in the queue until the queue is cleared
+        if (success)
+            queue_tail_ = (queue_tail_ + 1) % QUEUE_SIZE;
+    }
+}
+
+// @brief Plans a synchronized move of all axes and blocks until it is complete.
+bool MotionPlanner::execute_move(const Block_t& block) {
+    float start[AXIS_COUNT];    // [counts]
+    float delta[AXIS_COUNT];    // [counts]
+    float length_sq = 0.0f;     // [units^2]
+    if (!(block.feed_rate > 0.0f)) {
+        error_ |= ERROR_INVALID_MOVE;
+        return false;
+    }
+    for (size_t i = 0; i < AXIS_COUNT; ++i) {
+        // The previous move ended at the current setpoint (or the axis was
+        // commanded elsewhere in the meantime, in which case we start from there)
+        start[i] = axes[i]->controller_.pos_setpoint_;
+        delta[i] = 0.0f;
+        if (!block.has_target[i])
+            continue;
+        float counts_per_unit = config_.counts_per_unit[i];
+        if (counts_per_unit == 0.0f || !std::isfinite(counts_per_unit) || !std::isfinite(block.target[i])) {
+            error_ |= ERROR_INVALID_MOVE;
+            return false;
+        }
+        float target = block.target[i] * counts_per_unit;
+        delta[i] = block.relative ? target : target - start[i];
+        if (delta[i] == 0.0f)
+            continue;
+        // Only the axes that actually move need to be in closed loop control
+        if (axes[i]->current_state_ != Axis::AXIS_STATE_CLOSED_LOOP_CONTROL) {
+            error_ |= ERROR_AXIS_NOT_READY;
+            return false;
+        }
+        length_sq += SQ(delta[i] / counts_per_unit);
+    }
+
+    float length = sqrtf(length_sq); // [units]
+    if (length == 0.0f)
+        return true;
+
+    // Find the largest path velocity and accelerations [units/s, units/s^2]
+    // that respect the limits of all axes
+    float vel = block.feed_rate / 60.0f;
+    float accel = INFINITY;
+    float decel = INFINITY;
+    for (size_t i = 0; i < AXIS_COUNT; ++i) {
+        if (delta[i] == 0.0f)
+            continue;
+        float scale = fabsf(delta[i]) / length; // [counts/unit]
+        TrapezoidalTrajectory::Config_t& trap_config = axes[i]->trap_.config_;
+        vel = std::min(vel, trap_config.vel_limit / scale);
+        accel = std::min(accel, trap_config.accel_limit / scale);
+        decel = std::min(decel, trap_config.decel_limit / scale);
+    }
+
+    // With all limits scaled by the same factor, the per-axis
+    // profiles have identical timing.
+    // The control loop may still be evaluating trap_ (e.g. after a move_to_pos()
+    // from another interface), so the moves are planned into local trajectories
+    // first. The limits are passed explicitly, so their config is not used.
+    TrapezoidalTrajectory::Config_t plan_config;
+    TrapezoidalTrajectory plans[AXIS_COUNT] = { TrapezoidalTrajectory(plan_config), TrapezoidalTrajectory(plan_config) };
+    for (size_t i = 0; i < AXIS_COUNT; ++i) {
+        if (delta[i] == 0.0f)
+            continue;
+        float scale = fabsf(delta[i]) / length;
+        plans[i].planTrapezoidal(start[i] + delta[i], start[i], 0.0f,
+                                 vel * scale, accel * scale, decel * scale);
+    }
+
+    // Swap in and start all trajectories before any control loop runs again
+    uint32_t mask = cpu_enter_critical();
+    for (size_t i = 0; i < AXIS_COUNT; ++i) {
+        if (delta[i] != 0.0f) {
+            axes[i]->trap_.set_plan(plans[i]);
+            axes[i]->controller_.start_trajectory(start[i] + delta[i]);
+        }
+    }
+    cpu_exit_critical(mask);
+
+    // Wait for the move to complete. The controller drops out of trajectory
+    // control when it reaches the end of the trajectory.
+    for (;;) {
+        bool done = true;
+        for (size_t i = 0; i < AXIS_COUNT; ++i) {
+            if (delta[i] == 0.0f)
+                continue;
+            if (axes[i]->current_state_ != Axis::AXIS_STATE_CLOSED_LOOP_CONTROL) {
+                error_ |= ERROR_AXIS_NOT_READY;
+                return true; // the move was started, so don't repeat it
+            }
+            if (axes[i]->controller_.config_.control_mode == Controller::CTRL_MODE_TRAJECTORY_CONTROL)
+                done = false;
+        }
+        if (done)
+            return true;
+        osDelay(1);
+    }
+}
+
+bool MotionPlanner::enable_axes() {
+    for (size_t i = 0; i < AXIS_COUNT; ++i) {
+        if (axes[i]->current_state_ != Axis::AXIS_STATE_CLOSED_LOOP_CONTROL)
+            axes[i]->requested_state_ = Axis::AXIS_STATE_CLOSED_LOOP_CONTROL;
+    }
+
+    uint32_t deadline_ms = timeout_to_deadline(config_.enable_timeout);
+    for (;;) {
+        bool done = true;
+        for (size_t i = 0; i < AXIS_COUNT; ++i) {
+            if (axes[i]->current_state_ != Axis::AXIS_STATE_CLOSED_LOOP_CONTROL)
+                done = false;
+        }
+        if (done)
+            return true;
+        if (!is_in_the_future(deadline_ms)) {
+            error_ |= ERROR_ENABLE_FAILED;
+            return false;
+        }
+        osDelay(1);
+    }
+}
+
+void MotionPlanner::disable_axes() {
+    for (size_t i = 0; i < AXIS_COUNT; ++i) {
+        axes[i]->requested_state_ = Axis::AXIS_STATE_IDLE;
+    }
+}
@@ -0,0 +1,90 @@
+#ifndef __MOTION_PLANNER_HPP
+#define __MOTION_PLANNER_HPP
+
+#ifndef __ODRIVE_MAIN_H
+#error "This file should not be included directly. Include odrive_main.h instead."
+#endif
+
+// @brief Executes a queue of motion blocks on all axes, for example
+// blocks that were parsed from GCode.
+//
+// Each move is planned per axis using the axis' TrapezoidalTrajectory.
+// For moves that involve several axes, the kinematic limits of each axis are
+// scaled such that all axes start and finish at the same time, i.e. the move
+// is a straight line. Every move starts and ends at standstill.
+class MotionPlanner {
+public:
+    enum Error_t {
+        ERROR_NONE = 0,
+        ERROR_AXIS_NOT_READY = 0x01, // an axis was not in closed loop control while a move was due
+        ERROR_ENABLE_FAILED = 0x02,  // an axis failed to enter closed loop control
+        ERROR_INVALID_MOVE = 0x04,   // counts_per_unit, target or feed rate of a move was invalid
+    };
+
+    enum BlockType_t {
+        BLOCK_TYPE_MOVE,    //<! linear move to a target position
+        BLOCK_TYPE_DWELL,   //<! wait for some time
+        BLOCK_TYPE_ENABLE,  //<! put all axes into closed loop control
+        BLOCK_TYPE_DISABLE, //<! put all axes into idle
+    };
+
+    struct Block_t {
+        BlockType_t type;
+        bool relative;                // if true, target is relative to the end of the previous move
+        bool has_target[AXIS_COUNT];  // axes without target keep their position
+        float target[AXIS_COUNT];     // [units]
+        float feed_rate;              // [units/min], INFINITY for moves at the axes' speed limits
+        uint32_t dwell_ms;            // [ms]
+    };
+
+    struct Config_t {
+        float counts_per_unit[AXIS_COUNT] = { 1.0f, 1.0f }; // [counts/unit]
+        uint32_t enable_timeout = 2000; // [ms]
+    };
+
+    static constexpr size_t QUEUE_SIZE = 16;
+
+    explicit MotionPlanner(Config_t& config);
+
+    bool enqueue(const Block_t& block);
+    uint32_t get_free_space();
+    void clear();
+    void start_thread();
+    void run_planner_loop();
+
+    Config_t& config_;
+    Error_t error_ = ERROR_NONE;
+    bool busy_ = false;
+
+    osThreadId thread_id_;
+
+    // Producers (communication threads) enqueue inside a critical section, single consumer (planner thread)
+    Block_t queue_[QUEUE_SIZE];
+    volatile size_t queue_head_ = 0; // index of the next block to be written
+    volatile size_t queue_tail_ = 0; // index of the next block to be executed
+    volatile bool clear_requested_ = false;
+
+    // Communication protocol definitions
+    auto make_protocol_definitions() {
+        return make_protocol_member_list(
+            make_protocol_property("error", &error_),
+            make_protocol_ro_property("busy", &busy_),
+            make_protocol_object("config",
+                make_protocol_property("axis0_counts_per_unit", &config_.counts_per_unit[0]),
+                make_protocol_property("axis1_counts_per_unit", &config_.counts_per_unit[1]),
+                make_protocol_property("enable_timeout", &config_.enable_timeout)
+            ),
+            make_protocol_function("get_free_space", *this, &MotionPlanner::get_free_space),
+            make_protocol_function("clear", *this, &MotionPlanner::clear)
+        );
+    }
+
+private:
+    bool execute_move(const Block_t& block);
+    bool enable_axes();
+    void disable_axes();
+};
+
+DEFINE_ENUM_FLAG_OPERATORS(MotionPlanner::Error_t)
+
+#endif // __MOTION_PLANNER_HPP
@@ -19,6 +19,8 @@ Motor::Motor(const MotorHardwareConfig_t& hw_config,
             .nCSgpioNumber = gate_driver_config_.nCS_pin,
         }) {
     update_current_controller_gains();
+    winding_temp_ = config_.motor_ambient_temp;
+    reset_peak_current_lim();
 }
 
 // @brief Arms the PWM outputs that belong to this motor.
@@ -50,6 +52,20 @@ bool Motor::arm() {
 void Motor::reset_current_control() {
     current_control_.v_current_control_integral_d = 0.0f;
     current_control_.v_current_control_integral_q = 0.0f;
+    current_control_.mod_d = 0.0f;
+    current_control_.mod_q = 0.0f;
+    Id_field_weakening_ = 0.0f;
+    current_control_.Id_last = 0.0f;
+    current_control_.Iq_last = 0.0f;
+    current_control_.v_clipped_d = 0.0f;
+    current_control_.v_clipped_q = 0.0f;
+    current_control_.v_clipped_fundamental_d = 0.0f;
+    current_control_.v_clipped_fundamental_q = 0.0f;
+    current_control_.I_harmonic_d = 0.0f;
+    current_control_.I_harmonic_q = 0.0f;
+    current_control_.Id_predicted = 0.0f;
+    current_control_.Iq_predicted = 0.0f;
+    reset_param_estimation_window();
 }
 
 // @brief Tune the current controller based on phase resistance and inductance
@@ -60,6 +76,16 @@ void Motor::update_current_controller_gains() {
     current_control_.p_gain = config_.current_control_bandwidth * config_.phase_inductance;
     float plant_pole = config_.phase_resistance / config_.phase_inductance;
     current_control_.i_gain = plant_pole * current_control_.p_gain;
+
+    // Discretized RL load for the deadbeat controller:
+    // I[k+1] = plant_a * I[k] + plant_b * V[k]
+    if (config_.phase_resistance > 0.0f && config_.phase_inductance > 0.0f) {
+        current_control_.plant_a = expf(-plant_pole * current_meas_period);
+        current_control_.plant_b = (1.0f - current_control_.plant_a) / config_.phase_resistance;
+    } else {
+        current_control_.plant_a = 0.0f;
+        current_control_.plant_b = 0.0f; // falls back to PI control
+    }
 }
 
 // @brief Set up the gate drivers
@@ -106,6 +132,7 @@ void Motor::DRV8301_setup() {
     // We now have the gain settings we want to use, lets set up DRV chip
     DRV_SPI_8301_Vars_t* local_regs = &gate_driver_regs_;
     DRV8301_enable(&gate_driver_);
+    gate_driver_spi_claim(gate_driver_config_.spi);
     DRV8301_setupSpi(&gate_driver_, local_regs);
 
     local_regs->Ctrl_Reg_1.OC_MODE = DRV8301_OcMode_LatchShutDown;
@@ -117,6 +144,7 @@ void Motor::DRV8301_setup() {
     DRV8301_writeData(&gate_driver_, local_regs);
     local_regs->RcvCmd = true;
     DRV8301_readData(&gate_driver_, local_regs);
+    gate_driver_spi_release();
 }
 
 // @brief Checks if the gate driver is in operational state.
@@ -126,7 +154,9 @@ bool Motor::check_DRV_fault() {
     GPIO_PinState nFAULT_state = HAL_GPIO_ReadPin(gate_driver_config_.nFAULT_port, gate_driver_config_.nFAULT_pin);
     if (nFAULT_state == GPIO_PIN_RESET) {
         // Update DRV Fault Code
+        gate_driver_spi_claim(gate_driver_config_.spi);
         drv_fault_ = DRV8301_getFaultType(&gate_driver_);
+        gate_driver_spi_release();
         // Update/Cache all SPI device registers
         // DRV_SPI_8301_Vars_t* local_regs = &gate_driver_regs_;
         // local_regs->RcvCmd = true;
@@ -173,12 +203,83 @@ bool Motor::do_checks() {
         //error already set in function
         return false;
     }
+    update_thermal_model();
     return true;
 }
 
+// @brief Updates the I2t thermal model of the motor windings and the FETs
+// and the peak current limit that it grants.
+//
+// Both are modelled as first order systems that are heated by I2R losses.
+// The losses are normalized to current_lim, so that applying current_lim
+// continuously settles at motor_temp_limit (windings) and at
+// fet_temp_rise_at_current_lim above the thermistor (FETs). The winding
+// resistance is corrected for the copper temperature coefficient.
+// The FET model only covers the fast rise of the junctions over the board,
+// the board temperature itself is measured by the thermistor.
+//
+// While both predicted temperatures have headroom, current_lim_peak is
+// allowed. Over the last 10% towards the limits, the allowed current
+// falls smoothly back to current_lim, at which the temperatures settle.
+//
+// Called on every control loop iteration. The model itself is updated at
+// a lower rate so that the slow time constants don't drown in float
+// rounding.
+void Motor::update_thermal_model() {
+    static constexpr float kUpdatePeriod = 0.01f;         // [s]
+    static constexpr float kCopperTempCoeff = 0.00393f;   // [1/degC]
+    static constexpr float kPeakFadeRange = 0.1f;         // fraction of the temperature rise
+
+    if (armed_state_ == ARMED_STATE_ARMED && config_.motor_type == MOTOR_TYPE_HIGH_CURRENT)
+        thermal_model_I2_sum_ += SQ(current_control_.Id_measured) + SQ(current_control_.Iq_measured);
+    if (++thermal_model_samples_ < (uint32_t)(kUpdatePeriod * CURRENT_MEAS_HZ))
+        return;
+    float dt = (float)thermal_model_samples_ * current_meas_period;
+    float I2_mean = thermal_model_I2_sum_ / (float)thermal_model_samples_;
+    thermal_model_I2_sum_ = 0.0f;
+    thermal_model_samples_ = 0;
+
+    // Losses relative to the losses at current_lim
+    float load = (config_.current_lim > 0.0f) ? I2_mean / SQ(config_.current_lim) : 0.0f;
+
+    // Windings
+    float winding_rise_lim = config_.motor_temp_limit - config_.motor_ambient_temp;
+    float winding_rise = winding_temp_ - config_.motor_ambient_temp;
+    float resistance_factor = (1.0f + kCopperTempCoeff * winding_rise) / (1.0f + kCopperTempCoeff * winding_rise_lim);
+    float winding_rise_target = load * resistance_factor * winding_rise_lim;
+    winding_temp_ += std::min(dt / config_.motor_thermal_time_constant, 1.0f) * (winding_rise_target - winding_rise);
+
+    // FETs
+    float fet_rise_target = load * config_.fet_temp_rise_at_current_lim;
+    fet_temp_rise_ += std::min(dt / config_.fet_thermal_time_constant, 1.0f) * (fet_rise_target - fet_temp_rise_);
+    fet_temp_ = get_inverter_temp() + fet_temp_rise_;
+
+    // Fraction of the allowed temperature rise that is used up
+    float winding_usage = (winding_temp_ - config_.motor_ambient_temp) / winding_rise_lim;
+    float fet_usage = fet_temp_rise_ / config_.fet_temp_rise_at_current_lim;
+    float usage = std::max(winding_usage, fet_usage);
+    if (!(winding_rise_lim > 0.0f && config_.fet_temp_rise_at_current_lim > 0.0f))
+        usage = 1.0f; // invalid config: no peak current
+
+    float peak_fraction = (1.0f - usage) / kPeakFadeRange;
+    if (!(peak_fraction >= 0.0f)) // Funny polarity to also catch NaN
+        peak_fraction = 0.0f;
+    peak_fraction = std::min(peak_fraction, 1.0f);
+    float current_lim_peak = std::max(config_.current_lim_peak, config_.current_lim);
+    peak_current_lim_ = config_.current_lim + peak_fraction * (current_lim_peak - config_.current_lim);
+}
+
+// @brief Withdraws the peak current until the thermal model grants it again
+// on its next update. Called on startup and when the model is enabled.
+void Motor::reset_peak_current_lim() {
+    peak_current_lim_ = config_.current_lim;
+}
+
 float Motor::effective_current_lim() {
-    // Configured limit
+    // Configured limit, or peak limit granted by the thermal model
     float current_lim = config_.current_lim;
+    if (config_.enable_thermal_model)
+        current_lim = std::max(current_lim, peak_current_lim_);
     // Hardware limit
     if (axis_->motor_.config_.motor_type == Motor::MOTOR_TYPE_GIMBAL) {
         current_lim = std::min(current_lim, 0.98f*one_by_sqrt3*vbus_voltage);
@@ -191,6 +292,221 @@ float Motor::effective_current_lim() {
     return current_lim;
 }
 
+// @brief Limits the Iq setpoint such that the predicted regenerative bus
+// current of this motor stays within the budget of the DC bus voltage
+// regulation (see update_brake_current()).
+//
+// The other motors' bus current is taken into account: if they are motoring,
+// they consume regenerative power, if they are regenerating, they use up part
+// of the budget. The bus current of this motor is predicted from the
+// modulation of the last cycle, which is dominated by the back-EMF.
+float Motor::limit_regen_current(float Id_des, float Iq_des) {
+    float Ibus_allowed = regen_current_allowed;
+    for (size_t i = 0; i < AXIS_COUNT; ++i) {
+        Motor& other = axes[i]->motor_;
+        if (&other != this && other.armed_state_ == ARMED_STATE_ARMED)
+            Ibus_allowed += other.current_control_.Ibus;
+    }
+    if (Ibus_allowed < 0.0f)
+        Ibus_allowed = 0.0f;
+
+    float mod_d = current_control_.mod_d;
+    float mod_q = current_control_.mod_q;
+    float Ibus_predicted = mod_d * Id_des + mod_q * Iq_des;
+    if (Ibus_predicted < -Ibus_allowed && mod_q != 0.0f)
+        Iq_des = (-Ibus_allowed - mod_d * Id_des) / mod_q;
+    return Iq_des;
+}
+
+// @brief Maximum modulation magnitude of the current controller, in the
+// units of the magnitude invariant clarke transform
+float Motor::modulation_limit() {
+    float max_modulation = std::min(config_.max_modulation, config_.enable_overmodulation ? two_by_sqrt3 : 1.0f);
+    return max_modulation * sqrt3_by_2;
+}
+
+// @brief Generates the Id and Iq setpoints from the requested current.
+//
+// Without MTPA, the requested current goes to Iq. With MTPA, it is treated
+// as the current magnitude and split between Id and Iq such that it produces
+// the most torque, given the reluctance torque of a salient motor:
+// Id = (lambda - sqrt(lambda^2 + 8 (Lq-Ld)^2 I^2)) / (4 (Lq-Ld))
+//
+// Field weakening integrates the modulation magnitude of the last cycle
+// against a threshold below the modulation limit. Once the back-EMF gets
+// close to the bus voltage, this builds up negative Id, which reduces the
+// flux and lets the motor run above base speed.
+//
+// Id takes priority over Iq so that the voltage stays controllable, and the
+// total current magnitude is kept within effective_current_lim().
+void Motor::update_current_references(float current_setpoint, float* Id_des, float* Iq_des) {
+    float Id = 0.0f;
+    float Iq = current_setpoint;
+
+    if (config_.enable_mtpa) {
+        float flux = axis_->sensorless_estimator_.config_.pm_flux_linkage;
+        float dL = config_.phase_inductance_q - config_.phase_inductance_d;
+        float I_sq = SQ(current_setpoint);
+        // Rationalized form of the formula above, which doesn't divide by zero if dL = 0
+        Id = -2.0f * dL * I_sq / (flux + sqrtf(SQ(flux) + 8.0f * SQ(dL) * I_sq));
+        if (!(fabsf(Id) <= fabsf(current_setpoint))) // Funny polarity to also catch NaN
+            Id = 0.0f;
+        Iq = sqrtf(I_sq - SQ(Id));
+        if (current_setpoint < 0.0f)
+            Iq = -Iq;
+    }
+
+    if (config_.enable_field_weakening) {
+        float mod = sqrtf(SQ(current_control_.mod_d) + SQ(current_control_.mod_q));
+        float mod_threshold = config_.field_weakening_modulation * modulation_limit();
+        Id_field_weakening_ += config_.field_weakening_gain * current_meas_period * (mod_threshold - mod);
+        Id_field_weakening_ = std::min(std::max(Id_field_weakening_, -config_.field_weakening_max_current), 0.0f);
+        Id = std::min(Id, Id_field_weakening_);
+    } else {
+        Id_field_weakening_ = 0.0f;
+    }
+
+    float Ilim = effective_current_lim();
+    Id = std::max(Id, -Ilim);
+    float Iq_lim = sqrtf(std::max(SQ(Ilim) - SQ(Id), 0.0f));
+    Iq = std::min(std::max(Iq, -Iq_lim), Iq_lim);
+
+    *Id_des = Id;
+    *Iq_des = Iq;
+}
+
+// @brief One recursive least squares step with exponential forgetting.
+// The diagonal of the covariance is limited, so that it doesn't wind up in
+// directions that aren't excited (e.g. the flux linkage at standstill).
+static void rls_update(float theta[3], float P[3][3], const float phi[3], float y, float forgetting, float max_covariance) {
+    float P_phi[3];
+    float phi_P_phi = 0.0f;
+    float err = y;
+    for (size_t i = 0; i < 3; ++i) {
+        P_phi[i] = P[i][0] * phi[0] + P[i][1] * phi[1] + P[i][2] * phi[2];
+        phi_P_phi += phi[i] * P_phi[i];
+        err -= phi[i] * theta[i];
+    }
+    float denom = forgetting + phi_P_phi;
+    for (size_t i = 0; i < 3; ++i) {
+        theta[i] += P_phi[i] / denom * err;
+        for (size_t j = 0; j < 3; ++j)
+            P[i][j] = (P[i][j] - P_phi[i] * P_phi[j] / denom) / forgetting;
+    }
+    for (size_t i = 0; i < 3; ++i) {
+        if (P[i][i] > max_covariance) {
+            // Scaling row and column by the same factor keeps P positive definite
+            float scale = sqrtf(max_covariance / P[i][i]);
+            for (size_t j = 0; j < 3; ++j) {
+                P[i][j] *= scale;
+                P[j][i] *= scale;
+            }
+        }
+    }
+}
+
+// @brief Online estimation of the phase resistance, inductance and flux linkage.
+//
+// Fits the dq voltage equations
+//   Vd = R*Id + L*(dId/dt - omega*Iq)
+//   Vq = R*Iq + L*(dIq/dt + omega*Id) + flux*omega
+// with recursive least squares. The inputs are averaged over kDecimation
+// control cycles, which filters the PWM ripple and keeps the load on the
+// control loop low. Below param_estimation_min_current, R and L aren't
+// observable and the estimation pauses.
+//
+// @param Vd, Vq: voltage that was applied during the last cycle
+void Motor::update_param_estimation(float Id, float Iq, float Vd, float Vq, float phase_vel) {
+    static constexpr uint32_t kDecimation = 8;
+    static constexpr float kMaxCovariance = 10.0f;
+    ParamEstimation_t& est = param_est_;
+    SensorlessEstimator::Config_t& sensorless_config = axis_->sensorless_estimator_.config_;
+
+    if (!est.initialized) {
+        est.nominal[0] = config_.phase_resistance;
+        est.nominal[1] = config_.phase_inductance;
+        est.nominal[2] = sensorless_config.pm_flux_linkage;
+        if (!(est.nominal[0] > 0.0f && est.nominal[1] > 0.0f && est.nominal[2] > 0.0f))
+            return; // not calibrated
+        for (size_t i = 0; i < 3; ++i) {
+            est.theta[i] = 1.0f;
+            for (size_t j = 0; j < 3; ++j)
+                est.P[i][j] = (i == j) ? 1.0f : 0.0f;
+        }
+        est.initialized = true;
+        est.window_started = false;
+    }
+    if (!est.window_started) {
+        est.Id_start = Id;
+        est.Iq_start = Iq;
+        est.samples = 0;
+        est.Vd_sum = est.Vq_sum = est.Id_sum = est.Iq_sum = est.vel_sum = 0.0f;
+        est.window_started = true;
+    }
+
+    est.Vd_sum += Vd;
+    est.Vq_sum += Vq;
+    est.Id_sum += Id;
+    est.Iq_sum += Iq;
+    est.vel_sum += phase_vel;
+    if (++est.samples < kDecimation)
+        return;
+
+    float n = (float)est.samples;
+    float dt = n * current_meas_period;
+    float Vd_avg = est.Vd_sum / n;
+    float Vq_avg = est.Vq_sum / n;
+    float Id_avg = est.Id_sum / n;
+    float Iq_avg = est.Iq_sum / n;
+    float vel_avg = est.vel_sum / n;
+    float dId_dt = (Id - est.Id_start) / dt;
+    float dIq_dt = (Iq - est.Iq_start) / dt;
+    est.Id_start = Id;
+    est.Iq_start = Iq;
+    est.samples = 0;
+    est.Vd_sum = est.Vq_sum = est.Id_sum = est.Iq_sum = est.vel_sum = 0.0f;
+
+    if (SQ(Id_avg) + SQ(Iq_avg) < SQ(config_.param_estimation_min_current))
+        return;
+
+    float forgetting = 1.0f - dt / config_.param_estimation_time_constant;
+    forgetting = std::min(std::max(forgetting, 0.5f), 1.0f);
+    const float* nominal = est.nominal;
+    float phi_d[3] = {nominal[0] * Id_avg, nominal[1] * (dId_dt - vel_avg * Iq_avg), 0.0f};
+    float phi_q[3] = {nominal[0] * Iq_avg, nominal[1] * (dIq_dt + vel_avg * Id_avg), nominal[2] * vel_avg};
+    rls_update(est.theta, est.P, phi_d, Vd_avg, forgetting, kMaxCovariance);
+    rls_update(est.theta, est.P, phi_q, Vq_avg, 1.0f, kMaxCovariance);
+
+    // Plausibility bounds
+    float max_deviation = config_.param_estimation_max_deviation;
+    for (size_t i = 0; i < 3; ++i) {
+        if (!(est.theta[i] >= 1.0f - max_deviation)) // Funny polarity to also catch NaN
+            est.theta[i] = 1.0f - max_deviation;
+        est.theta[i] = std::min(est.theta[i], 1.0f + max_deviation);
+    }
+    est.R = est.theta[0] * nominal[0];
+    est.L = est.theta[1] * nominal[1];
+    est.flux = est.theta[2] * nominal[2];
+
+    if (config_.param_estimation_update_gains) {
+        config_.phase_resistance = est.R;
+        config_.phase_inductance = est.L;
+        sensorless_config.pm_flux_linkage = est.flux;
+        update_current_controller_gains();
+    }
+}
+
+// @brief Discards the samples of the current decimation interval, e.g. because
+// the current controller was reset and the samples aren't continuous anymore.
+void Motor::reset_param_estimation_window() {
+    param_est_.window_started = false;
+}
+
+// @brief Restarts the estimation from the configured R, L and flux linkage
+void Motor::restart_param_estimation() {
+    param_est_.initialized = false;
+}
+
 void Motor::log_timing(TimingLog_t log_idx) {
     static const uint16_t clocks_per_cnt = (uint16_t)((float)TIM_1_8_CLOCK_HZ / (float)TIM_APB1_CLOCK_HZ);
     uint16_t timing = clocks_per_cnt * htim13.Instance->CNT; // TODO: Use a hw_config
@@ -282,11 +598,65 @@ bool Motor::measure_phase_inductance(float voltage_low, float voltage_high) {
 }
 
 
+// @brief Measures the voltage error caused by the dead time and the FET drops.
+//
+// The voltage that drives a DC current along phase A is measured at two
+// current levels. The slope is the phase resistance, the offset is the
+// voltage that is lost to the dead time. In the alpha axis, phase A and the
+// return path through B and C each contribute, which adds up to 4/3 of the
+// per-phase voltage error.
+bool Motor::measure_deadtime_voltage(float test_current, float max_voltage) {
+    float I_low = 0.5f * test_current;
+    if (!measure_phase_resistance(I_low, max_voltage))
+        return false;
+    float V_low = config_.phase_resistance * I_low;
+    if (!measure_phase_resistance(test_current, max_voltage))
+        return false;
+    float V_high = config_.phase_resistance * test_current;
+
+    float R = (V_high - V_low) / (test_current - I_low);
+    float V_offset = V_low - R * I_low;
+    if (!(R > 0.0f))
+        return set_error(ERROR_PHASE_RESISTANCE_OUT_OF_RANGE), false;
+    config_.phase_resistance = R;
+    config_.deadtime_compensation_voltage = std::max(0.75f * V_offset, 0.0f);
+    return true;
+}
+
+// @brief Computes the voltage that compensates for the dead time.
+//
+// During the dead time, the phase voltage is set by the direction of the
+// phase current instead of the PWM, which costs deadtime_compensation_voltage
+// against the current. The compensation is ramped in linearly over
+// +-deadtime_compensation_current_band, because the current direction is
+// uncertain near zero.
+void Motor::compute_deadtime_compensation(float I_alpha, float I_beta, float* V_alpha, float* V_beta) {
+    float I_phase[3] = {
+        I_alpha,
+        -0.5f * I_alpha + sqrt3_by_2 * I_beta,
+        -0.5f * I_alpha - sqrt3_by_2 * I_beta
+    };
+    float V_phase[3];
+    float band = std::max(config_.deadtime_compensation_current_band, 1e-3f);
+    for (size_t i = 0; i < 3; ++i) {
+        float direction = std::min(std::max(I_phase[i] / band, -1.0f), 1.0f);
+        V_phase[i] = config_.deadtime_compensation_voltage * direction;
+    }
+    // Clarke transform
+    *V_alpha = (2.0f / 3.0f) * (V_phase[0] - 0.5f * (V_phase[1] + V_phase[2]));
+    *V_beta = one_by_sqrt3 * (V_phase[1] - V_phase[2]);
+}
+
 bool Motor::run_calibration() {
     float R_calib_max_voltage = config_.resistance_calib_max_voltage;
     if (config_.motor_type == MOTOR_TYPE_HIGH_CURRENT) {
-        if (!measure_phase_resistance(config_.calibration_current, R_calib_max_voltage))
-            return false;
+        if (config_.enable_deadtime_compensation) {
+            if (!measure_deadtime_voltage(config_.calibration_current, R_calib_max_voltage))
+                return false;
+        } else {
+            if (!measure_phase_resistance(config_.calibration_current, R_calib_max_voltage))
+                return false;
+        }
         if (!measure_phase_inductance(-R_calib_max_voltage, R_calib_max_voltage))
             return false;
     } else if (config_.motor_type == MOTOR_TYPE_GIMBAL) {
@@ -296,18 +666,43 @@ bool Motor::run_calibration() {
     }
 
     update_current_controller_gains();
+    restart_param_estimation();
     
     is_calibrated_ = true;
     return true;
 }
 
+// Minimum time for which phases B and C stay low (at the bottom of the PWM
+// period) and high (at the top), as a fraction of the period. This covers
+// the dead time, the settling of the shunt amplifiers and the ADC sampling.
+static constexpr float kMinCurrentSenseTime = 0.1f;
+
+// A compare value beyond the period keeps the phase low for the whole period
+static uint16_t timing_to_clocks(float t) {
+    if (t >= 1.0f)
+        return TIM_1_8_PERIOD_CLOCKS + 1;
+    return (uint16_t)(t * (float)TIM_1_8_PERIOD_CLOCKS);
+}
+
+// Without a known current vector, DPWM1 assumes unity power factor
 bool Motor::enqueue_modulation_timings(float mod_alpha, float mod_beta) {
+    return enqueue_modulation_timings(mod_alpha, mod_beta, mod_alpha, mod_beta);
+}
+
+// @param I_alpha, I_beta: current vector during the next period (only its
+// direction is used, to centre the clamped segments of DPWM1)
+bool Motor::enqueue_modulation_timings(float mod_alpha, float mod_beta, float I_alpha, float I_beta) {
     float tA, tB, tC;
     if (SVM(mod_alpha, mod_beta, &tA, &tB, &tC) != 0)
         return set_error(ERROR_MODULATION_MAGNITUDE), false;
-    next_timings_[0] = (uint16_t)(tA * (float)TIM_1_8_PERIOD_CLOCKS);
-    next_timings_[1] = (uint16_t)(tB * (float)TIM_1_8_PERIOD_CLOCKS);
-    next_timings_[2] = (uint16_t)(tC * (float)TIM_1_8_PERIOD_CLOCKS);
+    DPWM(mod_alpha, mod_beta, I_alpha, I_beta, config_.dpwm_mode, kMinCurrentSenseTime, &tA, &tB, &tC);
+    next_timings_[0] = timing_to_clocks(tA);
+    next_timings_[1] = timing_to_clocks(tB);
+    next_timings_[2] = timing_to_clocks(tC);
+    next_timings_allow_dc_calib_ = tB <= 1.0f - kMinCurrentSenseTime && tC <= 1.0f - kMinCurrentSenseTime;
+    // DPWM() shifts the timings to keep this window whenever possible. Allow for its rounding errors.
+    next_timings_current_meas_ = (tB >= 0.999f * kMinCurrentSenseTime ? CURRENT_MEAS_PHB : 0)
+                               | (tC >= 0.999f * kMinCurrentSenseTime ? CURRENT_MEAS_PHC : 0);
     next_timings_valid_ = true;
     return true;
 }
@@ -331,11 +726,12 @@ bool Motor::FOC_voltage(float v_d, float v_q, float pwm_phase) {
     return enqueue_voltage_timings(v_alpha, v_beta);
 }
 
-bool Motor::FOC_current(float Id_des, float Iq_des, float I_phase, float pwm_phase) {
+bool Motor::FOC_current(float Id_des, float Iq_des, float I_phase, float pwm_phase, float phase_vel) {
     // Syntactic sugar
     CurrentControl_t& ictrl = current_control_;
 
     // For Reporting
+    ictrl.Id_setpoint = Id_des;
     ictrl.Iq_setpoint = Iq_des;
 
     // Check for current sense saturation
@@ -349,11 +745,31 @@ bool Motor::FOC_current(float Id_des, float Iq_des, float I_phase, float pwm_pha
     float Ialpha = -current_meas_.phB - current_meas_.phC;
     float Ibeta = one_by_sqrt3 * (current_meas_.phB - current_meas_.phC);
 
-    // Park transform
     float c_I = our_arm_cos_f32(I_phase);
     float s_I = our_arm_sin_f32(I_phase);
+
+    if (current_meas_valid_ != CURRENT_MEAS_ALL) {
+        // Phase B or C had no low side window at high modulation. The current
+        // is nearly constant in the rotating frame, so the last one is used
+        // as a prediction and corrected along the phase that was measured.
+        Ialpha = c_I * ictrl.Id_last - s_I * ictrl.Iq_last;
+        Ibeta = s_I * ictrl.Id_last + c_I * ictrl.Iq_last;
+        if (current_meas_valid_ & CURRENT_MEAS_PHB) {
+            float err = current_meas_.phB - (-0.5f * Ialpha + sqrt3_by_2 * Ibeta);
+            Ialpha -= 0.5f * err;
+            Ibeta += sqrt3_by_2 * err;
+        } else if (current_meas_valid_ & CURRENT_MEAS_PHC) {
+            float err = current_meas_.phC - (-0.5f * Ialpha - sqrt3_by_2 * Ibeta);
+            Ialpha -= 0.5f * err;
+            Ibeta -= sqrt3_by_2 * err;
+        }
+    }
+
+    // Park transform
     float Id = c_I * Ialpha + s_I * Ibeta;
     float Iq = c_I * Ibeta - s_I * Ialpha;
+    ictrl.Id_last = Id;
+    ictrl.Iq_last = Iq;
     ictrl.Iq_measured += ictrl.I_measured_report_filter_k * (Iq - ictrl.Iq_measured);
     ictrl.Id_measured += ictrl.I_measured_report_filter_k * (Id - ictrl.Id_measured);
 
@@ -364,49 +780,159 @@ bool Motor::FOC_current(float Id_des, float Iq_des, float I_phase, float pwm_pha
         return false;
     }
 
-    // Current error
-    float Ierr_d = Id_des - Id;
-    float Ierr_q = Iq_des - Iq;
+    // In overmodulation, the voltage that is clipped off by the SVM hexagon
+    // reduces the fundamental and injects 6k+-1 harmonics. The fundamental
+    // deficit is left to the controller. The harmonics are above its
+    // bandwidth, so the harmonic current that they cause in the inductance is
+    // estimated and removed from the feedback, instead of being amplified by
+    // the P gain. v_clipped is the commanded minus the applied voltage, so the
+    // harmonic current is driven by its negative.
+    if (config_.phase_inductance > 0.0f) {
+        float k = std::min(config_.current_control_bandwidth * current_meas_period, 1.0f);
+        ictrl.v_clipped_fundamental_d += k * (ictrl.v_clipped_d - ictrl.v_clipped_fundamental_d);
+        ictrl.v_clipped_fundamental_q += k * (ictrl.v_clipped_q - ictrl.v_clipped_fundamental_q);
+        float dI_per_V = current_meas_period / config_.phase_inductance;
+        ictrl.I_harmonic_d -= dI_per_V * (ictrl.v_clipped_d - ictrl.v_clipped_fundamental_d) + k * ictrl.I_harmonic_d;
+        ictrl.I_harmonic_q -= dI_per_V * (ictrl.v_clipped_q - ictrl.v_clipped_fundamental_q) + k * ictrl.I_harmonic_q;
+    }
 
-    // TODO look into feed forward terms (esp omega, since PI pole maps to RL tau)
-    // Apply PI control
-    float Vd = ictrl.v_current_control_integral_d + Ierr_d * ictrl.p_gain;
-    float Vq = ictrl.v_current_control_integral_q + Ierr_q * ictrl.p_gain;
+    // Current error
+    float Id_fb = Id - ictrl.I_harmonic_d;
+    float Iq_fb = Iq - ictrl.I_harmonic_q;
+    float Ierr_d = Id_des - Id_fb;
+    float Ierr_q = Iq_des - Iq_fb;
+
+    // Feedforward from the motor model:
+    // Vd = R*Id - omega*Lq*Iq
+    // Vq = R*Iq + omega*(Ld*Id + flux)
+    // This leaves the PI controller with just the inductance (whose pole it
+    // cancels) instead of having to integrate up the back-EMF at speed.
+    float Vd_emf = 0.0f;
+    float Vq_emf = 0.0f;
+    if (config_.enable_current_control_feedforward) {
+        float Ld = config_.phase_inductance_d > 0.0f ? config_.phase_inductance_d : config_.phase_inductance;
+        float Lq = config_.phase_inductance_q > 0.0f ? config_.phase_inductance_q : config_.phase_inductance;
+        float flux = axis_->sensorless_estimator_.config_.pm_flux_linkage;
+        Vd_emf = -phase_vel * Lq * Iq_des;
+        Vq_emf = phase_vel * (Ld * Id_des + flux);
+    }
 
     float mod_to_V = (2.0f / 3.0f) * vbus_voltage;
     float V_to_mod = 1.0f / mod_to_V;
+
+    if (config_.enable_param_estimation)
+        update_param_estimation(Id, Iq, mod_to_V * ictrl.mod_d, mod_to_V * ictrl.mod_q, phase_vel);
+
+    // The back-EMF is what remains of the applied voltage after the
+    // resistive and inductive drop. Its magnitude is phase_vel * flux linkage,
+    // independent of the angle between current and rotor.
+    if (measure_back_emf_ && axis_->lockin_state_ == Axis::LOCKIN_STATE_CONST_VEL) {
+        float Ed = mod_to_V * ictrl.mod_d - config_.phase_resistance * Id + phase_vel * config_.phase_inductance * Iq;
+        float Eq = mod_to_V * ictrl.mod_q - config_.phase_resistance * Iq - phase_vel * config_.phase_inductance * Id;
+        back_emf_sum_ += sqrtf(Ed * Ed + Eq * Eq);
+        back_emf_vel_sum_ += fabsf(phase_vel);
+    }
+
+    bool deadbeat = config_.current_control_mode == CURRENT_CONTROL_MODE_DEADBEAT && ictrl.plant_b > 0.0f;
+    float Vd, Vq;
+    if (deadbeat) {
+        // Deadbeat control with delay compensation: the voltage computed now
+        // is applied during the next period. The current at the start of that
+        // period is predicted from the voltage applied in this period. The new
+        // voltage then takes the current (by deadbeat_gain) to the setpoint by
+        // the end of the next period.
+        // The integrators estimate the disturbance voltage (back-EMF, cross
+        // coupling and model errors) from the error of the last prediction.
+        float k = std::min(config_.current_control_bandwidth * current_meas_period, 1.0f);
+        ictrl.v_current_control_integral_d -= k * (Id_fb - ictrl.Id_predicted) / ictrl.plant_b;
+        ictrl.v_current_control_integral_q -= k * (Iq_fb - ictrl.Iq_predicted) / ictrl.plant_b;
+        float Vd_dist = Vd_emf + ictrl.v_current_control_integral_d;
+        float Vq_dist = Vq_emf + ictrl.v_current_control_integral_q;
+
+        float Id_next = ictrl.plant_a * Id_fb + ictrl.plant_b * (mod_to_V * ictrl.mod_d - Vd_dist);
+        float Iq_next = ictrl.plant_a * Iq_fb + ictrl.plant_b * (mod_to_V * ictrl.mod_q - Vq_dist);
+        float Id_target = Id_next + config_.deadbeat_gain * (Id_des - Id_next);
+        float Iq_target = Iq_next + config_.deadbeat_gain * (Iq_des - Iq_next);
+        Vd = (Id_target - ictrl.plant_a * Id_next) / ictrl.plant_b + Vd_dist;
+        Vq = (Iq_target - ictrl.plant_a * Iq_next) / ictrl.plant_b + Vq_dist;
+        ictrl.Id_predicted = Id_next;
+        ictrl.Iq_predicted = Iq_next;
+    } else {
+        // Apply PI control
+        Vd = ictrl.v_current_control_integral_d + Ierr_d * ictrl.p_gain;
+        Vq = ictrl.v_current_control_integral_q + Ierr_q * ictrl.p_gain;
+        if (config_.enable_current_control_feedforward) {
+            Vd += config_.phase_resistance * Id_des + Vd_emf;
+            Vq += config_.phase_resistance * Iq_des + Vq_emf;
+        }
+    }
+
+    // High frequency injection for the sensorless estimator
+    Vd += Vd_injection_;
+
     float mod_d = V_to_mod * Vd;
     float mod_q = V_to_mod * Vq;
 
     // Vector modulation saturation, lock integrator if saturated
-    // TODO make maximum modulation configurable
-    float mod_scalefactor = 0.80f * sqrt3_by_2 * 1.0f / sqrtf(mod_d * mod_d + mod_q * mod_q);
+    // The deadbeat controller accounts for the saturation in its next prediction.
+    float mod_scalefactor = modulation_limit() / sqrtf(mod_d * mod_d + mod_q * mod_q);
     if (mod_scalefactor < 1.0f) {
         mod_d *= mod_scalefactor;
         mod_q *= mod_scalefactor;
-        // TODO make decayfactor configurable
-        ictrl.v_current_control_integral_d *= 0.99f;
-        ictrl.v_current_control_integral_q *= 0.99f;
-    } else {
-        ictrl.v_current_control_integral_d += Ierr_d * (ictrl.i_gain * current_meas_period);
-        ictrl.v_current_control_integral_q += Ierr_q * (ictrl.i_gain * current_meas_period);
+        if (!deadbeat) {
+            ictrl.v_current_control_integral_d *= config_.current_control_integrator_decay;
+            ictrl.v_current_control_integral_q *= config_.current_control_integrator_decay;
+        }
     }
 
-    // Compute estimated bus current
-    ictrl.Ibus = mod_d * Id + mod_q * Iq;
-
     // Inverse park transform
     float c_p = our_arm_cos_f32(pwm_phase);
     float s_p = our_arm_sin_f32(pwm_phase);
     float mod_alpha = c_p * mod_d - s_p * mod_q;
     float mod_beta  = c_p * mod_q + s_p * mod_d;
 
+    // Overmodulation
+    float clip_scale = 1.0f;
+    if (config_.enable_overmodulation)
+        clip_scale = SVM_clip_to_hexagon(&mod_alpha, &mod_beta);
+    ictrl.v_clipped_d = (1.0f - clip_scale) * mod_to_V * mod_d;
+    ictrl.v_clipped_q = (1.0f - clip_scale) * mod_to_V * mod_q;
+    mod_d *= clip_scale;
+    mod_q *= clip_scale;
+
+    // Integrate only if the voltage was applied as commanded. While the vector
+    // is clipped onto the hexagon, the integrator is held.
+    if (!deadbeat && mod_scalefactor >= 1.0f && clip_scale >= 1.0f) {
+        ictrl.v_current_control_integral_d += Ierr_d * (ictrl.i_gain * current_meas_period);
+        ictrl.v_current_control_integral_q += Ierr_q * (ictrl.i_gain * current_meas_period);
+    }
+
+    // Compute estimated bus current
+    ictrl.Ibus = mod_d * Id + mod_q * Iq;
+    ictrl.mod_d = mod_d;
+    ictrl.mod_q = mod_q;
+
     // Report final applied voltage in stationary frame (for sensorles estimator)
     ictrl.final_v_alpha = mod_to_V * mod_alpha;
     ictrl.final_v_beta = mod_to_V * mod_beta;
 
+    // Current vector during the next period
+    float Ialpha_des = c_p * Id_des - s_p * Iq_des;
+    float Ibeta_des = c_p * Iq_des + s_p * Id_des;
+
+    // Dead time compensation
+    // The reported voltage above is the one that reaches the motor after the
+    // dead time, so it doesn't include the compensation.
+    if (config_.enable_deadtime_compensation) {
+        float V_alpha, V_beta;
+        compute_deadtime_compensation(Ialpha_des, Ibeta_des, &V_alpha, &V_beta);
+        mod_alpha += V_to_mod * V_alpha;
+        mod_beta += V_to_mod * V_beta;
+        SVM_clip_to_hexagon(&mod_alpha, &mod_beta);
+    }
+
     // Apply SVM
-    if (!enqueue_modulation_timings(mod_alpha, mod_beta))
+    if (!enqueue_modulation_timings(mod_alpha, mod_beta, Ialpha_des, Ibeta_des))
         return false; // error set inside enqueue_modulation_timings
     log_timing(TIMING_LOG_FOC_CURRENT);
 
@@ -424,7 +950,11 @@ bool Motor::update(float current_setpoint, float phase, float phase_vel) {
     // Execute current command
     // TODO: move this into the mot
     if (config_.motor_type == MOTOR_TYPE_HIGH_CURRENT) {
-        if(!FOC_current(0.0f, current_setpoint, phase, pwm_phase)){
+        float Id, Iq;
+        update_current_references(current_setpoint, &Id, &Iq);
+        Id += Id_injection_;
+        Iq = limit_regen_current(Id, Iq);
+        if(!FOC_current(Id, Iq, phase, pwm_phase, phase_vel)){
             return false;
         }
     } else if (config_.motor_type == MOTOR_TYPE_GIMBAL) {
@@ -32,6 +32,11 @@ public:
         MOTOR_TYPE_GIMBAL = 2
     };
 
+    enum CurrentControlMode_t {
+        CURRENT_CONTROL_MODE_PI = 0,
+        CURRENT_CONTROL_MODE_DEADBEAT = 1
+    };
+
     struct Iph_BC_t {
         float phB;
         float phC;
@@ -46,12 +51,55 @@ public:
         // Voltage applied at end of cycle:
         float final_v_alpha; // [V]
         float final_v_beta; // [V]
+        float Id_setpoint; // [A]
         float Iq_setpoint; // [A]
         float Iq_measured; // [A]
         float Id_measured; // [A]
         float I_measured_report_filter_k;
         float max_allowed_current; // [A]
         float overcurrent_trip_level; // [A]
+        // Modulation applied in the last cycle
+        float mod_d; // [1]
+        float mod_q; // [1]
+        // Last measured or estimated current (see current_meas_valid_)
+        float Id_last; // [A]
+        float Iq_last; // [A]
+        // Overmodulation: voltage that was clipped in the last cycle, its
+        // fundamental (low-pass) and the harmonic current that it causes
+        float v_clipped_d; // [V]
+        float v_clipped_q; // [V]
+        float v_clipped_fundamental_d; // [V]
+        float v_clipped_fundamental_q; // [V]
+        float I_harmonic_d; // [A]
+        float I_harmonic_q; // [A]
+        // Deadbeat control
+        float plant_a; // [1]
+        float plant_b; // [A/V]
+        float Id_predicted; // [A]
+        float Iq_predicted; // [A]
+    };
+
+    // Online estimation of R, L and flux linkage (see update_param_estimation())
+    // The parameters are estimated relative to their nominal values (theta = 1)
+    // to keep the recursive least squares well conditioned in float.
+    struct ParamEstimation_t {
+        float R = 0.0f;     // [Ohm] estimate
+        float L = 0.0f;     // [H] estimate
+        float flux = 0.0f;  // [V/(rad/s)] estimate
+        float nominal[3] = {0.0f, 0.0f, 0.0f};  // R, L, flux at the start of the estimation
+        float theta[3] = {1.0f, 1.0f, 1.0f};    // estimates relative to nominal
+        float P[3][3] = {{0.0f}};               // covariance
+        // Accumulated over the decimation interval
+        float Vd_sum = 0.0f;
+        float Vq_sum = 0.0f;
+        float Id_sum = 0.0f;
+        float Iq_sum = 0.0f;
+        float vel_sum = 0.0f;
+        float Id_start = 0.0f;
+        float Iq_start = 0.0f;
+        uint32_t samples = 0;
+        bool window_started = false;    // Id_start/Iq_start and the sums are valid
+        bool initialized = false;       // nominal, theta and P are valid
     };
 
     // NOTE: for gimbal motors, all units of A are instead V.
@@ -73,8 +121,62 @@ public:
         // Value used to compute shunt amplifier gains
         float requested_current_range = 60.0f; // [A]
         float current_control_bandwidth = 1000.0f;  // [rad/s]
+        // The deadbeat controller removes deadbeat_gain of the current error
+        // per cycle (1.0 = within one cycle). It needs the phase resistance
+        // and inductance and otherwise falls back to PI control.
+        CurrentControlMode_t current_control_mode = CURRENT_CONTROL_MODE_PI;
+        float deadbeat_gain = 0.8f;
+        // Modulation magnitude limit as a fraction of the linear SVM range.
+        // Up to 1.0, or up to 2/sqrt(3) (the corners of the SVM hexagon) if
+        // enable_overmodulation is true.
+        float max_modulation = 0.80f;
+        bool enable_overmodulation = false;
+        float current_control_integrator_decay = 0.99f; // per cycle while the modulation is saturated
+        // Feedforward of the resistive drop, the back-EMF and the dq cross
+        // coupling into the current controller. Uses phase_resistance,
+        // phase_inductance (or phase_inductance_d/q if set) and
+        // sensorless_estimator.config.pm_flux_linkage.
+        bool enable_current_control_feedforward = false;
+        // Online parameter estimation. The estimates are limited to
+        // +-param_estimation_max_deviation around the values at startup.
+        // If param_estimation_update_gains is true, they are written to
+        // phase_resistance, phase_inductance and the sensorless estimator's
+        // pm_flux_linkage, and the current controller is retuned.
+        bool enable_param_estimation = false;
+        bool param_estimation_update_gains = false;
+        float param_estimation_time_constant = 2.0f;     // [s] forgetting time
+        float param_estimation_min_current = 1.0f;       // [A]
+        float param_estimation_max_deviation = 0.5f;     // fraction of the nominal value
+        // Current reference generation (see update_current_references())
+        // MTPA splits the current between Id and Iq for maximum torque per amp
+        // on salient (IPM) motors.
+        bool enable_mtpa = false;
+        float phase_inductance_d = 0.0f;              // [H]
+        float phase_inductance_q = 0.0f;              // [H]
+        // Field weakening injects negative Id when the modulation magnitude
+        // exceeds field_weakening_modulation (fraction of max_modulation).
+        bool enable_field_weakening = false;
+        float field_weakening_modulation = 0.95f;
+        float field_weakening_gain = 2000.0f;         // [A/s] per unit of modulation
+        float field_weakening_max_current = 10.0f;    // [A]
+        DPWMMode_t dpwm_mode = DPWM_MODE_NONE;      // discontinuous PWM to reduce switching losses
+        // Dead time compensation. If enabled, the motor calibration measures
+        // deadtime_compensation_voltage along with the phase resistance.
+        bool enable_deadtime_compensation = false;
+        float deadtime_compensation_voltage = 0.0f;        // [V] per phase
+        float deadtime_compensation_current_band = 0.5f;   // [A]
         float inverter_temp_limit_lower = 100;
         float inverter_temp_limit_upper = 120;
+        // I2t thermal model (see update_thermal_model())
+        // If enabled, the current may exceed current_lim up to current_lim_peak
+        // for as long as the model predicts thermal headroom.
+        bool enable_thermal_model = false;
+        float current_lim_peak = 20.0f;               // [A]
+        float motor_ambient_temp = 25.0f;             // [degC]
+        float motor_temp_limit = 100.0f;              // [degC] winding temperature that is reached with current_lim applied continuously
+        float motor_thermal_time_constant = 120.0f;   // [s]
+        float fet_temp_rise_at_current_lim = 20.0f;   // [degC] FET temperature above the thermistor with current_lim applied continuously
+        float fet_thermal_time_constant = 2.0f;       // [s]
     };
 
     enum TimingLog_t {
@@ -115,16 +217,27 @@ public:
     bool do_checks();
     float get_inverter_temp();
     bool update_thermal_limits();
+    void update_thermal_model();
+    void reset_peak_current_lim();
     float effective_current_lim();
+    float limit_regen_current(float Id_des, float Iq_des);
+    float modulation_limit();
+    void update_current_references(float current_setpoint, float* Id_des, float* Iq_des);
+    void update_param_estimation(float Id, float Iq, float Vd, float Vq, float phase_vel);
+    void reset_param_estimation_window();
+    void restart_param_estimation();
     void log_timing(TimingLog_t log_idx);
     float phase_current_from_adcval(uint32_t ADCValue);
     bool measure_phase_resistance(float test_current, float max_voltage);
     bool measure_phase_inductance(float voltage_low, float voltage_high);
+    bool measure_deadtime_voltage(float test_current, float max_voltage);
+    void compute_deadtime_compensation(float I_alpha, float I_beta, float* V_alpha, float* V_beta);
     bool run_calibration();
     bool enqueue_modulation_timings(float mod_alpha, float mod_beta);
+    bool enqueue_modulation_timings(float mod_alpha, float mod_beta, float I_alpha, float I_beta);
     bool enqueue_voltage_timings(float v_alpha, float v_beta);
     bool FOC_voltage(float v_d, float v_q, float pwm_phase);
-    bool FOC_current(float Id_des, float Iq_des, float I_phase, float pwm_phase);
+    bool FOC_current(float Id_des, float Iq_des, float I_phase, float pwm_phase, float phase_vel);
     bool update(float current_setpoint, float phase, float phase_vel);
 
     const MotorHardwareConfig_t& hw_config_;
@@ -141,6 +254,23 @@ public:
         TIM_1_8_PERIOD_CLOCKS / 2
     };
     bool next_timings_valid_ = false;
+    // The DC calibration samples the shunts at the top of the PWM period,
+    // which needs phases B and C to be high (see pwm_trig_adc_cb).
+    bool next_timings_allow_dc_calib_ = true;
+    bool applied_timings_allow_dc_calib_ = true;
+    bool dc_calib_allowed_ = true;
+    // Likewise, the current measurement at the bottom of the PWM period
+    // needs phases B and C to be low. These are bitmasks of the phases
+    // whose measurement is valid.
+    enum : uint8_t {
+        CURRENT_MEAS_PHB = 0x1,
+        CURRENT_MEAS_PHC = 0x2,
+        CURRENT_MEAS_ALL = CURRENT_MEAS_PHB | CURRENT_MEAS_PHC,
+    };
+    uint8_t next_timings_current_meas_ = CURRENT_MEAS_ALL;
+    uint8_t applied_timings_current_meas_ = CURRENT_MEAS_ALL;
+    uint8_t current_meas_allowed_ = CURRENT_MEAS_ALL;
+    uint8_t current_meas_valid_ = CURRENT_MEAS_ALL; // of the latest current_meas_
     uint16_t last_cpu_time_ = 0;
     int timing_log_index_ = 0;
     uint16_t timing_log_[TIMING_LOG_NUM_SLOTS] = { 0 };
@@ -162,16 +292,47 @@ public:
         .Ibus = 0.0f,
         .final_v_alpha = 0.0f,
         .final_v_beta = 0.0f,
+        .Id_setpoint = 0.0f,
         .Iq_setpoint = 0.0f,
         .Iq_measured = 0.0f,
         .Id_measured = 0.0f,
         .I_measured_report_filter_k = 1.0f,
         .max_allowed_current = 0.0f,
         .overcurrent_trip_level = 0.0f,
+        .mod_d = 0.0f,
+        .mod_q = 0.0f,
+        .Id_last = 0.0f,
+        .Iq_last = 0.0f,
+        .v_clipped_d = 0.0f,
+        .v_clipped_q = 0.0f,
+        .v_clipped_fundamental_d = 0.0f,
+        .v_clipped_fundamental_q = 0.0f,
+        .I_harmonic_d = 0.0f,
+        .I_harmonic_q = 0.0f,
+        .plant_a = 0.0f,
+        .plant_b = 0.0f,
+        .Id_predicted = 0.0f,
+        .Iq_predicted = 0.0f,
     };
     DRV8301_FaultType_e drv_fault_ = DRV8301_FaultType_NoFault;
     DRV_SPI_8301_Vars_t gate_driver_regs_; //Local view of DRV registers (initialized by DRV8301_setup)
     float thermal_current_lim_ = 10.0f;  //[A]
+    float Id_field_weakening_ = 0.0f;  // [A]
+    ParamEstimation_t param_est_;
+    // Injection by the sensorless estimator, see SensorlessEstimator::update_hfi()
+    float Vd_injection_ = 0.0f;  // [V] added to the d-axis voltage
+    float Id_injection_ = 0.0f;  // [A] added to the d-axis current setpoint
+    // Back-EMF measurement, see Axis::run_flux_linkage_calibration()
+    bool measure_back_emf_ = false;
+    float back_emf_sum_ = 0.0f;      // [V]
+    float back_emf_vel_sum_ = 0.0f;  // [rad/s]
+    // Thermal model state
+    float winding_temp_ = 25.0f;  // [degC] predicted
+    float fet_temp_ = 25.0f;      // [degC] predicted
+    float fet_temp_rise_ = 0.0f;  // [degC] predicted FET temperature above the thermistor
+    float peak_current_lim_ = 0.0f;   // [A] current limit granted by the thermal model
+    float thermal_model_I2_sum_ = 0.0f;  // [A^2] accumulated since the last model update
+    uint32_t thermal_model_samples_ = 0;
 
     // Communication protocol definitions
     auto make_protocol_definitions() {
@@ -185,7 +346,18 @@ public:
             make_protocol_property("DC_calib_phC", &DC_calib_.phC),
             make_protocol_property("phase_current_rev_gain", &phase_current_rev_gain_),
             make_protocol_ro_property("thermal_current_lim", &thermal_current_lim_),
+            make_protocol_ro_property("Id_field_weakening", &Id_field_weakening_),
+            make_protocol_object("param_estimation",
+                make_protocol_ro_property("phase_resistance", &param_est_.R),
+                make_protocol_ro_property("phase_inductance", &param_est_.L),
+                make_protocol_ro_property("pm_flux_linkage", &param_est_.flux)
+            ),
             make_protocol_function("get_inverter_temp", *this, &Motor::get_inverter_temp),
+            make_protocol_object("thermal_model",
+                make_protocol_ro_property("winding_temp", &winding_temp_),
+                make_protocol_ro_property("fet_temp", &fet_temp_),
+                make_protocol_ro_property("peak_current_lim", &peak_current_lim_)
+            ),
             make_protocol_object("current_control",
                 make_protocol_property("p_gain", &current_control_.p_gain),
                 make_protocol_property("i_gain", &current_control_.i_gain),
@@ -194,12 +366,15 @@ public:
                 make_protocol_property("Ibus", &current_control_.Ibus),
                 make_protocol_property("final_v_alpha", &current_control_.final_v_alpha),
                 make_protocol_property("final_v_beta", &current_control_.final_v_beta),
+                make_protocol_property("Id_setpoint", &current_control_.Id_setpoint),
                 make_protocol_property("Iq_setpoint", &current_control_.Iq_setpoint),
                 make_protocol_property("Iq_measured", &current_control_.Iq_measured),
                 make_protocol_property("Id_measured", &current_control_.Id_measured),
                 make_protocol_property("I_measured_report_filter_k", &current_control_.I_measured_report_filter_k),
                 make_protocol_ro_property("max_allowed_current", &current_control_.max_allowed_current),
-                make_protocol_ro_property("overcurrent_trip_level", &current_control_.overcurrent_trip_level)
+                make_protocol_ro_property("overcurrent_trip_level", &current_control_.overcurrent_trip_level),
+                make_protocol_ro_property("I_harmonic_d", &current_control_.I_harmonic_d),
+                make_protocol_ro_property("I_harmonic_q", &current_control_.I_harmonic_q)
             ),
             make_protocol_object("gate_driver",
                 make_protocol_ro_property("drv_fault", &drv_fault_)
@@ -224,17 +399,50 @@ public:
                 make_protocol_property("pole_pairs", &config_.pole_pairs),
                 make_protocol_property("calibration_current", &config_.calibration_current),
                 make_protocol_property("resistance_calib_max_voltage", &config_.resistance_calib_max_voltage),
-                make_protocol_property("phase_inductance", &config_.phase_inductance),
-                make_protocol_property("phase_resistance", &config_.phase_resistance),
+                make_protocol_property("phase_inductance", &config_.phase_inductance,
+                    [](void* ctx) { static_cast<Motor*>(ctx)->restart_param_estimation(); }, this),
+                make_protocol_property("phase_resistance", &config_.phase_resistance,
+                    [](void* ctx) { static_cast<Motor*>(ctx)->restart_param_estimation(); }, this),
                 make_protocol_property("direction", &config_.direction),
                 make_protocol_property("motor_type", &config_.motor_type),
+                make_protocol_property("dpwm_mode", &config_.dpwm_mode),
+                make_protocol_property("enable_deadtime_compensation", &config_.enable_deadtime_compensation),
+                make_protocol_property("deadtime_compensation_voltage", &config_.deadtime_compensation_voltage),
+                make_protocol_property("deadtime_compensation_current_band", &config_.deadtime_compensation_current_band),
                 make_protocol_property("current_lim", &config_.current_lim),
                 make_protocol_property("current_lim_tolerance", &config_.current_lim_tolerance),
                 make_protocol_property("inverter_temp_limit_lower", &config_.inverter_temp_limit_lower),
                 make_protocol_property("inverter_temp_limit_upper", &config_.inverter_temp_limit_upper),
+                make_protocol_property("enable_thermal_model", &config_.enable_thermal_model,
+                    [](void* ctx) { static_cast<Motor*>(ctx)->reset_peak_current_lim(); }, this),
+                make_protocol_property("current_lim_peak", &config_.current_lim_peak),
+                make_protocol_property("motor_ambient_temp", &config_.motor_ambient_temp),
+                make_protocol_property("motor_temp_limit", &config_.motor_temp_limit),
+                make_protocol_property("motor_thermal_time_constant", &config_.motor_thermal_time_constant),
+                make_protocol_property("fet_temp_rise_at_current_lim", &config_.fet_temp_rise_at_current_lim),
+                make_protocol_property("fet_thermal_time_constant", &config_.fet_thermal_time_constant),
                 make_protocol_property("requested_current_range", &config_.requested_current_range),
                 make_protocol_property("current_control_bandwidth", &config_.current_control_bandwidth,
-                    [](void* ctx) { static_cast<Motor*>(ctx)->update_current_controller_gains(); }, this)
+                    [](void* ctx) { static_cast<Motor*>(ctx)->update_current_controller_gains(); }, this),
+                make_protocol_property("current_control_mode", &config_.current_control_mode),
+                make_protocol_property("deadbeat_gain", &config_.deadbeat_gain),
+                make_protocol_property("max_modulation", &config_.max_modulation),
+                make_protocol_property("enable_overmodulation", &config_.enable_overmodulation),
+                make_protocol_property("current_control_integrator_decay", &config_.current_control_integrator_decay),
+                make_protocol_property("enable_current_control_feedforward", &config_.enable_current_control_feedforward),
+                make_protocol_property("enable_param_estimation", &config_.enable_param_estimation,
+                    [](void* ctx) { static_cast<Motor*>(ctx)->reset_param_estimation_window(); }, this),
+                make_protocol_property("param_estimation_update_gains", &config_.param_estimation_update_gains),
+                make_protocol_property("param_estimation_time_constant", &config_.param_estimation_time_constant),
+                make_protocol_property("param_estimation_min_current", &config_.param_estimation_min_current),
+                make_protocol_property("param_estimation_max_deviation", &config_.param_estimation_max_deviation),
+                make_protocol_property("enable_mtpa", &config_.enable_mtpa),
+                make_protocol_property("phase_inductance_d", &config_.phase_inductance_d),
+                make_protocol_property("phase_inductance_q", &config_.phase_inductance_q),
+                make_protocol_property("enable_field_weakening", &config_.enable_field_weakening),
+                make_protocol_property("field_weakening_modulation", &config_.field_weakening_modulation),
+                make_protocol_property("field_weakening_gain", &config_.field_weakening_gain),
+                make_protocol_property("field_weakening_max_current", &config_.field_weakening_max_current)
             )
         );
     }
@@ -64,6 +64,10 @@ struct PWMMapping_t {
     endpoint_ref_t endpoint = { 0 };
     float min = 0;
     float max = 0;
+    bool median_filter = false;     //<! reject single-sample glitches with a 3-sample median filter
+    float filter_bandwidth = 0.0f;  //<! [Hz] bandwidth of the low-pass filter, 0 to disable
+    float deadband = 0.0f;          //<! width of the band around the center of the input range that maps to the center value, as a fraction of the input range
+    float rate_limit = 0.0f;        //<! [units/s] maximum rate of change of the mapped value, 0 to disable
 };
 
 // @brief general user configurable board configuration
@@ -81,17 +85,27 @@ struct BoardConfig_t {
                                                                         //<! This protects against cases in which the power supply fails to dissipate
                                                                         //<! the brake power if the brake resistor is disabled.
                                                                         //<! The default is 26V for the 24V board version and 52V for the 48V board version.
+    bool enable_dc_bus_voltage_regulation = false;                      //<! limit regenerative current and ramp up the brake resistor as vbus_voltage approaches the overvoltage trip level
+    float dc_bus_overvoltage_ramp_start = 1.02f * HW_VERSION_VOLTAGE;   //<! [V] voltage at which the regulation starts
+    float dc_bus_overvoltage_ramp_end = 1.06f * HW_VERSION_VOLTAGE;     //<! [V] voltage at which regeneration is fully blocked and the brake resistor runs at full duty.
+                                                                        //<! Should be above dc_bus_overvoltage_ramp_start and below dc_bus_overvoltage_trip_level.
+    float dc_bus_voltage_regulation_gain = 10.0f;                       //<! [A/V] regenerative current allowed per volt below dc_bus_overvoltage_ramp_end, on top of what the brake resistor and power supply can absorb
+    float max_regen_current = 0.0f;                                     //<! [A] bus current that the power supply can absorb (e.g. when running from a battery)
     PWMMapping_t pwm_mappings[GPIO_COUNT];
     PWMMapping_t analog_mappings[GPIO_COUNT];
+    float adc_filter_bandwidth[ADC_CHANNEL_COUNT] = { 0 };             //<! [Hz] bandwidth of the low-pass filter of each ADC1 channel,
+                                                                        //<! 0 to only average the oversampled measurements
 };
 extern BoardConfig_t board_config;
 extern bool user_config_loaded_;
 
 class Axis;
 class Motor;
+class MotionPlanner;
 
 constexpr size_t AXIS_COUNT = 2;
 extern Axis *axes[AXIS_COUNT];
+extern MotionPlanner *motion_planner;
 
 // if you use the oscilloscope feature you can bump up this value
 #define OSCILLOSCOPE_SIZE 128
@@ -119,6 +133,8 @@ inline ENUMTYPE operator ~ (ENUMTYPE a) { return static_cast<ENUMTYPE>(~static_c
 #include <motor.hpp>
 #include <trapTraj.hpp>
 #include <axis.hpp>
+#include <motion_planner.hpp>
+#include <input_mapping.hpp>
 #include <communication/communication.h>
 
 #endif // __cplusplus
@@ -69,13 +69,159 @@ bool SensorlessEstimator::update() {
     }
 
     // predict PLL phase with velocity
+    float pll_pos_last = pll_pos_;
     pll_pos_ = wrap_pm_pi(pll_pos_ + current_meas_period * vel_estimate_);
     // update PLL phase with observer permanent magnet phase
-    phase_ = fast_atan2(eta[1], eta[0]);
+    // (blended with the HFI estimate at low speed)
+    float observer_phase = fast_atan2(eta[1], eta[0]);
+    if (hfi_state_ != HFI_STATE_INACTIVE)
+        phase_ = update_hfi(I_alpha_beta, observer_phase);
+    else
+        phase_ = observer_phase;
     float delta_phase = wrap_pm_pi(phase_ - pll_pos_);
     pll_pos_ = wrap_pm_pi(pll_pos_ + current_meas_period * pll_kp * delta_phase);
+    pos_estimate_ += wrap_pm_pi(pll_pos_ - pll_pos_last);
     // update PLL velocity
     vel_estimate_ += current_meas_period * pll_ki * delta_phase;
 
     return true;
 };
+
+// @brief Starts the high frequency injection (HFI).
+// @param detect_polarity: true if the rotor position is unknown. The HFI
+// estimate then first converges and the magnet polarity is detected before
+// the estimate is used. Otherwise the HFI starts from the current estimate.
+bool SensorlessEstimator::start_hfi(bool detect_polarity) {
+    float Ld = axis_->motor_.config_.phase_inductance_d;
+    float Lq = axis_->motor_.config_.phase_inductance_q;
+    if (!(Ld > 0.0f && Lq > Ld)) {
+        error_ |= ERROR_NO_SALIENCY;
+        return false;
+    }
+    // Response of the q-axis current to a position error (see update_hfi())
+    hfi_gain_ = config_.hfi_voltage * current_meas_period * (1.0f / Ld - 1.0f / Lq);
+
+    hfi_pos_ = phase_;
+    hfi_vel_ = detect_polarity ? 0.0f : vel_estimate_;
+    hfi_Id_ = 0.0f;
+    hfi_observer_weight_ = 0.0f;
+    hfi_sign_memory_[0] = hfi_sign_memory_[1] = hfi_sign_memory_[2] = 0.0f;
+    dI_dq_last_[0] = dI_dq_last_[1] = 0.0f;
+    hfi_polarity_sum_ = 0.0f;
+    hfi_samples_ = 0;
+    hfi_state_ = detect_polarity ? HFI_STATE_CONVERGE : HFI_STATE_RUNNING;
+    return true;
+}
+
+void SensorlessEstimator::stop_hfi() {
+    hfi_state_ = HFI_STATE_INACTIVE;
+    hfi_voltage_ = 0.0f;
+    hfi_Id_ = 0.0f;
+    hfi_observer_weight_ = 1.0f;
+}
+
+// @brief Position estimation by high frequency injection.
+//
+// A square wave of +-hfi_voltage on the estimated d-axis flips every cycle.
+// With Ld < Lq, a position error turns part of the current response into
+// the estimated q-axis:
+//   dIq = hfi_voltage * T / 2 * (1/Ld - 1/Lq) * sin(2 * error)
+// which drives a separate PLL. This works at standstill, where the flux
+// observer has no back-EMF to work with. The result only has half the
+// period of the electrical angle, so the magnet polarity is detected first:
+// a d-axis current along the magnet saturates the iron, which lowers Ld and
+// increases the response.
+//
+// Around hfi_crossover_vel, the returned phase is blended over to
+// observer_phase, after which the injection stops.
+float SensorlessEstimator::update_hfi(const float I_alpha_beta[2], float observer_phase) {
+    static const float kConvergeTime = 0.05f; // [s]
+    static const float kPolarityDetectionTime = 0.05f; // [s] per polarity
+    static const uint32_t kConvergeCycles = static_cast<uint32_t>(kConvergeTime * current_meas_hz);
+    static const uint32_t kPolarityDetectionCycles = static_cast<uint32_t>(kPolarityDetectionTime * current_meas_hz);
+
+    // Current steps in the frame that the voltage was injected in
+    float c = our_arm_cos_f32(phase_);
+    float s = our_arm_sin_f32(phase_);
+    float dI_alpha = I_alpha_beta[0] - I_alpha_beta_last_[0];
+    float dI_beta = I_alpha_beta[1] - I_alpha_beta_last_[1];
+    I_alpha_beta_last_[0] = I_alpha_beta[0];
+    I_alpha_beta_last_[1] = I_alpha_beta[1];
+    float dI_d = c * dI_alpha + s * dI_beta;
+    float dI_q = c * dI_beta - s * dI_alpha;
+
+    // The current step of this cycle is the response to the voltage computed
+    // two cycles ago (see update()). The injection flips every cycle while the
+    // fundamental doesn't, so the difference of two steps is the response
+    // to the injection alone.
+    float sign = hfi_sign_memory_[1];
+    bool valid = sign != 0.0f && hfi_sign_memory_[2] == -sign;
+    float hf_d = 0.5f * sign * (dI_d - dI_dq_last_[0]);
+    float hf_q = 0.5f * sign * (dI_q - dI_dq_last_[1]);
+    dI_dq_last_[0] = dI_d;
+    dI_dq_last_[1] = dI_q;
+
+    // PLL
+    float pll_kp = 2.0f * config_.hfi_bandwidth;
+    float pll_ki = 0.25f * (pll_kp * pll_kp);
+    if (!(current_meas_period * pll_kp < 1.0f)) {
+        error_ |= ERROR_UNSTABLE_GAIN;
+        stop_hfi();
+        return observer_phase;
+    }
+    float pos_error = valid ? hf_q / hfi_gain_ : 0.0f;
+    hfi_pos_ = wrap_pm_pi(hfi_pos_ + current_meas_period * (hfi_vel_ + pll_kp * pos_error));
+    hfi_vel_ += current_meas_period * pll_ki * pos_error;
+
+    // Polarity detection
+    ++hfi_samples_;
+    switch (hfi_state_) {
+        case HFI_STATE_CONVERGE: {
+            if (hfi_samples_ >= kConvergeCycles) {
+                hfi_state_ = HFI_STATE_POLARITY_POS;
+                hfi_Id_ = config_.hfi_polarity_detection_current;
+                hfi_samples_ = 0;
+            }
+        } break;
+        case HFI_STATE_POLARITY_POS: {
+            if (valid)
+                hfi_polarity_sum_ += hf_d;
+            if (hfi_samples_ >= kPolarityDetectionCycles) {
+                hfi_state_ = HFI_STATE_POLARITY_NEG;
+                hfi_Id_ = -config_.hfi_polarity_detection_current;
+                hfi_samples_ = 0;
+            }
+        } break;
+        case HFI_STATE_POLARITY_NEG: {
+            if (valid)
+                hfi_polarity_sum_ -= hf_d;
+            if (hfi_samples_ >= kPolarityDetectionCycles) {
+                if (hfi_polarity_sum_ < 0.0f)
+                    hfi_pos_ = wrap_pm_pi(hfi_pos_ + M_PI);
+                hfi_state_ = HFI_STATE_RUNNING;
+                hfi_Id_ = 0.0f;
+            }
+        } break;
+        default: break;
+    }
+
+    // Blend over to the observer between 0.5 and 1.5 times the crossover velocity
+    float weight = 0.0f;
+    if (hfi_state_ == HFI_STATE_RUNNING && config_.hfi_crossover_vel > 0.0f)
+        weight = std::min(std::max(fabsf(vel_estimate_) / config_.hfi_crossover_vel - 0.5f, 0.0f), 1.0f);
+    hfi_observer_weight_ = weight;
+    if (weight >= 1.0f) {
+        // Track the observer, so that the HFI takes over smoothly when slowing down
+        hfi_pos_ = observer_phase;
+        hfi_vel_ = vel_estimate_;
+    }
+
+    // Injection for the next cycle
+    float next_sign = (weight < 1.0f) ? ((hfi_sign_memory_[0] > 0.0f) ? -1.0f : 1.0f) : 0.0f;
+    hfi_sign_memory_[2] = hfi_sign_memory_[1];
+    hfi_sign_memory_[1] = hfi_sign_memory_[0];
+    hfi_sign_memory_[0] = next_sign;
+    hfi_voltage_ = next_sign * config_.hfi_voltage;
+
+    return wrap_pm_pi(hfi_pos_ + weight * wrap_pm_pi(observer_phase - hfi_pos_));
+}
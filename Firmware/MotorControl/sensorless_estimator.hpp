@@ -6,17 +6,36 @@ public:
     enum Error_t {
         ERROR_NONE = 0,
         ERROR_UNSTABLE_GAIN = 0x01,
+        ERROR_FLUX_LINKAGE_OUT_OF_RANGE = 0x02,
+        ERROR_NO_SALIENCY = 0x04,
+    };
+
+    enum HfiState_t {
+        HFI_STATE_INACTIVE,
+        HFI_STATE_CONVERGE,
+        HFI_STATE_POLARITY_POS,
+        HFI_STATE_POLARITY_NEG,
+        HFI_STATE_RUNNING,
     };
 
     struct Config_t {
         float observer_gain = 1000.0f; // [rad/s]
         float pll_bandwidth = 1000.0f;  // [rad/s]
         float pm_flux_linkage = 1.58e-3f; // [V / (rad/s)]  { 5.51328895422 / (<pole pairs> * <rpm/v>) }
+        // High frequency injection, needs motor.config.phase_inductance_d < phase_inductance_q
+        bool enable_hfi = false;
+        float hfi_voltage = 2.0f;         // [V]
+        float hfi_bandwidth = 200.0f;     // [rad/s]
+        float hfi_crossover_vel = 200.0f; // [rad/s] electrical
+        float hfi_polarity_detection_current = 5.0f; // [A]
     };
 
     explicit SensorlessEstimator(Config_t& config);
 
     bool update();
+    bool start_hfi(bool detect_polarity);
+    void stop_hfi();
+    float update_hfi(const float I_alpha_beta[2], float observer_phase);
 
     Axis* axis_ = nullptr; // set by Axis constructor
     Config_t& config_;
@@ -26,12 +45,27 @@ public:
     float phase_ = 0.0f;                        // [rad]
     float pll_pos_ = 0.0f;                      // [rad]
     float vel_estimate_ = 0.0f;                      // [rad/s]
+    float pos_estimate_ = 0.0f;                 // [rad] unwrapped pll_pos_
     // float pll_kp_ = 0.0f;                       // [rad/s / rad]
     // float pll_ki_ = 0.0f;                       // [(rad/s^2) / rad]
     float flux_state_[2] = {0.0f, 0.0f};        // [Vs]
     float V_alpha_beta_memory_[2] = {0.0f, 0.0f}; // [V]
     bool estimator_good_ = false;
 
+    // High frequency injection
+    HfiState_t hfi_state_ = HFI_STATE_INACTIVE;
+    float hfi_voltage_ = 0.0f;                  // [V] d-axis voltage to inject in this cycle
+    float hfi_Id_ = 0.0f;                       // [A] d-axis current to add in this cycle
+    float hfi_pos_ = 0.0f;                      // [rad]
+    float hfi_vel_ = 0.0f;                      // [rad/s]
+    float hfi_observer_weight_ = 0.0f;          // [1] 0: HFI only, 1: observer only
+    float hfi_gain_ = 0.0f;                     // [A/rad] response to a position error
+    float hfi_sign_memory_[3] = {0.0f, 0.0f, 0.0f}; // injected polarity of the last cycles
+    float I_alpha_beta_last_[2] = {0.0f, 0.0f}; // [A]
+    float dI_dq_last_[2] = {0.0f, 0.0f};        // [A]
+    float hfi_polarity_sum_ = 0.0f;             // [A]
+    uint32_t hfi_samples_ = 0;
+
     // Communication protocol definitions
     auto make_protocol_definitions() {
         return make_protocol_member_list(
@@ -39,12 +73,20 @@ public:
             make_protocol_property("phase", &phase_),
             make_protocol_property("pll_pos", &pll_pos_),
             make_protocol_property("vel_estimate", &vel_estimate_),
+            make_protocol_ro_property("pos_estimate", &pos_estimate_),
+            make_protocol_ro_property("hfi_state", &hfi_state_),
+            make_protocol_ro_property("hfi_observer_weight", &hfi_observer_weight_),
             // make_protocol_property("pll_kp", &pll_kp_),
             // make_protocol_property("pll_ki", &pll_ki_),
             make_protocol_object("config",
                 make_protocol_property("observer_gain", &config_.observer_gain),
                 make_protocol_property("pll_bandwidth", &config_.pll_bandwidth),
-                make_protocol_property("pm_flux_linkage", &config_.pm_flux_linkage)
+                make_protocol_property("pm_flux_linkage", &config_.pm_flux_linkage),
+                make_protocol_property("enable_hfi", &config_.enable_hfi),
+                make_protocol_property("hfi_voltage", &config_.hfi_voltage),
+                make_protocol_property("hfi_bandwidth", &config_.hfi_bandwidth),
+                make_protocol_property("hfi_crossover_vel", &config_.hfi_crossover_vel),
+                make_protocol_property("hfi_polarity_detection_current", &config_.hfi_polarity_detection_current)
             )
         );
     }
@@ -0,0 +1,158 @@
+/*
+* Host tests for the absolute SPI encoder protocol (abs_spi.h)
+* Build and run with:
+*   g++ -std=c++14 -Wall -I.. abs_spi_test.cpp -o abs_spi_test && ./abs_spi_test
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <math.h>
+
+#include <abs_spi.h>
+
+// Builds a valid frame of an absolute SPI encoder for a 14 bit position
+static uint16_t make_ams_frame(uint16_t pos) {
+    return pos | (__builtin_parity(pos) ? 0x8000 : 0);
+}
+static uint16_t make_cui_frame(uint16_t pos) {
+    return pos | (__builtin_parity(pos & 0x2AAA) ? 0 : 0x8000)
+               | (__builtin_parity(pos & 0x1555) ? 0 : 0x4000);
+}
+
+bool frame_decoder_test() {
+    for (uint32_t pos = 0; pos < (1 << 14); ++pos) {
+        uint16_t frames[] = { make_ams_frame(pos), make_cui_frame(pos) };
+        for (size_t mode = 0; mode < 2; ++mode) {
+            int (*decode)(uint16_t, uint16_t*) = mode ? decode_cui_frame : decode_ams_frame;
+            const char* name = mode ? "CUI" : "AMS";
+            uint16_t result = 0xffff;
+            if (decode(frames[mode], &result) != 0 || result != pos) {
+                printf("%s frame 0x%04x: expected position %u but got %u\n", name, frames[mode], pos, result);
+                return false;
+            }
+            // Any single bit error must be detected
+            for (int bit = 0; bit < 16; ++bit) {
+                uint16_t corrupted = frames[mode] ^ (1 << bit);
+                if (decode(corrupted, &result) == 0) {
+                    printf("%s frame 0x%04x: bit error not detected\n", name, corrupted);
+                    return false;
+                }
+            }
+        }
+
+        // The error flag fails the frame even with valid parity
+        uint16_t result;
+        if (decode_ams_frame(make_ams_frame(pos) ^ 0xC000, &result) == 0) {
+            printf("AMS error flag not detected for position %u\n", pos);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool pos_to_count_test() {
+    struct count_case_t {
+        uint16_t pos;
+        int cpr;
+        int32_t count;
+        float fraction;
+    };
+    const count_case_t count_cases[] = {
+        // position, cpr, count, fraction
+        { 0, 16384, 0, 0.0f },
+        { 0x3FFF, 16384, 16383, 0.0f },
+        { 0x3FFF, 8192, 8191, 0.5f },
+        { 0x2000, 4000, 2000, 0.0f },
+        { 3, 4000, 0, 0.732421875f },
+    };
+    for (size_t i = 0; i < sizeof(count_cases) / sizeof(count_cases[0]); ++i) {
+        const count_case_t& test_case = count_cases[i];
+        int32_t count;
+        float fraction;
+        abs_spi_pos_to_count(test_case.pos, test_case.cpr, &count, &fraction);
+        if (count != test_case.count || fabsf(fraction - test_case.fraction) > 1e-4f) {
+            printf("position %u at cpr %d: expected %d + %f but got %d + %f\n", test_case.pos, test_case.cpr,
+                    test_case.count, (double)test_case.fraction, count, (double)fraction);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Emulates the SPI side of an encoder. The CUI AMT23 samples the position when
+// CS goes low. An AMS encoder answers with the angle that it latched during
+// the previous transaction.
+struct EmulatedEncoder {
+    bool is_ams;
+    uint16_t latched_pos = 0;
+
+    uint16_t transfer(uint16_t command, uint16_t pos) {
+        if (!is_ams)
+            return make_cui_frame(pos);
+        uint16_t frame = make_ams_frame(latched_pos);
+        if (command == AMS_CMD_READ_ANGLECOM)
+            latched_pos = pos;
+        return frame;
+    }
+};
+
+// Runs a rotor at constant velocity through the timing of Encoder::sample_now()
+// and Encoder::update(): in each control period, sample_now() latches the frame
+// of the transaction that was started in the previous period and starts the
+// next transaction, then update() decodes the latched frame. After the latency
+// compensation, the measured position must match the rotor position at the
+// time of sample_now() within the resolution of the encoder.
+bool latency_test() {
+    const int cpr = 1 << 14;
+    const float vels[] = { 0.0f, 37.5f, -120.25f }; // [count/period]
+    for (int is_ams = 0; is_ams < 2; ++is_ams) {
+        for (size_t v = 0; v < sizeof(vels) / sizeof(vels[0]); ++v) {
+            float vel = vels[v];
+            EmulatedEncoder encoder = { is_ams != 0 };
+            uint16_t dma_rx = 0;
+            bool dma_done = false;
+            for (int period = 0; period < 200; ++period) {
+                float rotor_pos = 1000.0f + vel * (float)period;
+                uint16_t sampled_pos = (uint16_t)((int32_t)floorf(rotor_pos) & (cpr - 1));
+
+                // sample_now()
+                uint16_t frame = dma_rx;
+                bool frame_valid = dma_done;
+                dma_rx = encoder.transfer(is_ams ? AMS_CMD_READ_ANGLECOM : 0x0000, sampled_pos);
+                dma_done = true;
+
+                // update()
+                uint16_t raw_pos;
+                int status = is_ams ? decode_ams_frame(frame, &raw_pos) : decode_cui_frame(frame, &raw_pos);
+                if (!frame_valid || status != 0 || period < 3)
+                    continue;
+                int32_t count;
+                float fraction;
+                abs_spi_pos_to_count(raw_pos, cpr, &count, &fraction);
+                float measured = (float)count + fraction + abs_spi_latency_periods(is_ams) * vel;
+                float error = fmodf(measured - rotor_pos, (float)cpr);
+                if (error > 0.5f * (float)cpr) error -= (float)cpr;
+                if (error < -0.5f * (float)cpr) error += (float)cpr;
+                if (fabsf(error) > 1.0f) {
+                    printf("%s at %f count/period: position error %f in period %d\n",
+                            is_ams ? "AMS" : "CUI", (double)vel, (double)error, period);
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+int main(void) {
+    bool test_result = frame_decoder_test();
+    test_result = pos_to_count_test() && test_result;
+    test_result = latency_test() && test_result;
+    if (test_result) {
+        printf("all tests passed\n");
+        return 0;
+    } else {
+        printf("some tests failed\n");
+        return -1;
+    }
+}
@@ -91,4 +91,20 @@ TrapezoidalTrajectory::Step_t TrapezoidalTrajectory::eval(float t) {
     }
 
     return trajStep;
-}
\ No newline at end of file
+}
+
+// @brief Takes over the trajectory that was planned in another instance.
+// This allows planning without modifying a trajectory that is being evaluated.
+void TrapezoidalTrajectory::set_plan(const TrapezoidalTrajectory& plan) {
+    Xi_ = plan.Xi_;
+    Xf_ = plan.Xf_;
+    Vi_ = plan.Vi_;
+    Ar_ = plan.Ar_;
+    Vr_ = plan.Vr_;
+    Dr_ = plan.Dr_;
+    Ta_ = plan.Ta_;
+    Tv_ = plan.Tv_;
+    Td_ = plan.Td_;
+    Tf_ = plan.Tf_;
+    yAccel_ = plan.yAccel_;
+}
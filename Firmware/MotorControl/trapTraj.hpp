@@ -20,6 +20,7 @@ public:
     bool planTrapezoidal(float Xf, float Xi, float Vi,
                          float Vmax, float Amax, float Dmax);
     Step_t eval(float t);
+    void set_plan(const TrapezoidalTrajectory& plan);
 
     auto make_protocol_definitions() {
         return make_protocol_member_list(
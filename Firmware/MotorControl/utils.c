@@ -122,6 +122,104 @@ int SVM(float alpha, float beta, float* tA, float* tB, float* tC) {
     return result_valid ? 0 : -1;
 }
 
+// Discontinuous PWM: all three timings are shifted by the same offset, which
+// doesn't change the line-to-line voltages, such that one phase doesn't switch
+// for the whole period. Depending on the power factor, this saves a third to
+// a half of the switching losses, at the cost of more current ripple.
+//
+// A low timing means a high phase voltage: 0.0 clamps a phase to the positive
+// rail and 1.0 clamps it to the negative rail.
+//
+// The phase currents are measured on the low side shunts of phases B and C
+// at the bottom of the PWM period. The offset is limited such that these two
+// phases stay low for at least min_t_BC, as far as the modulation magnitude
+// allows. With DPWMMAX or DPWM1, this means that phases B and C are never
+// fully clamped high. DPWM_MODE_NONE leaves the centred SVPWM timings as they
+// are. Near the linear modulation limit, the phase without a window is then
+// flagged by the caller.
+void DPWM(float alpha, float beta, float I_alpha, float I_beta, DPWMMode_t mode, float min_t_BC, float* tA, float* tB, float* tC) {
+    float* t_min = tA;
+    float* t_max = tA;
+    if (*tB < *t_min) t_min = tB;
+    if (*tC < *t_min) t_min = tC;
+    if (*tB > *t_max) t_max = tB;
+    if (*tC > *t_max) t_max = tC;
+    float shift_high = -*t_min;       // clamps the highest phase to the positive rail
+    float shift_low = 1.0f - *t_max;  // clamps the lowest phase to the negative rail
+
+    float shift;
+    switch (mode) {
+        case DPWM_MODE_NONE: return;
+        case DPWM_MODE_MIN: shift = shift_low; break;
+        case DPWM_MODE_MAX: shift = shift_high; break;
+        case DPWM_MODE_1: {
+            // Clamp the phase with the largest current magnitude, so that the
+            // clamped segments are centred on the current vector rather than on
+            // the voltage vector. The clamped phase must still be the highest or
+            // lowest one, which holds as long as the current vector is within
+            // 30deg of the voltage vector. Beyond that (or without current), the
+            // voltage vector rotated by up to 30deg towards the current is used.
+            float x = I_alpha;
+            float y = I_beta;
+            float dot = alpha * I_alpha + beta * I_beta;
+            float cross = alpha * I_beta - beta * I_alpha;
+            if (dot == 0.0f && cross == 0.0f) {
+                x = alpha;
+                y = beta;
+            } else if (!(dot > 0.0f && fabsf(cross) <= one_by_sqrt3 * dot)) {
+                float s = (cross < 0.0f) ? -0.5f : 0.5f; // sin(+-30deg)
+                x = sqrt3_by_2 * alpha - s * beta;
+                y = sqrt3_by_2 * beta + s * alpha;
+            }
+            // The lowest and highest phase values sum up to minus the middle one.
+            float xA = x;
+            float xB = -0.5f * x + sqrt3_by_2 * y;
+            float xC = -0.5f * x - sqrt3_by_2 * y;
+            float x_mid = MACRO_MAX(MACRO_MIN(xA, xB), MACRO_MIN(MACRO_MAX(xA, xB), xC));
+            shift = (x_mid < 0.0f) ? shift_high : shift_low;
+        } break;
+        default: return;
+    }
+
+    // Keep the current measurement window of phases B and C
+    float shift_meas = min_t_BC - MACRO_MIN(*tB, *tC);
+    if (shift < shift_meas)
+        shift = shift_meas;
+    if (shift > shift_low)
+        shift = shift_low;
+
+    *tA += shift;
+    *tB += shift;
+    *tC += shift;
+
+    // Avoid rounding errors on the clamped phase
+    if (shift == shift_high)
+        *t_min = 0.0f;
+    else if (shift == shift_low)
+        *t_max = 1.0f;
+}
+
+// Overmodulation: scales a modulation vector that lies outside of the SVM
+// hexagon back onto its edge, keeping the angle (minimum phase error).
+// The spread between the highest and the lowest phase voltage may not exceed
+// 1.5 in the units of the magnitude invariant clarke transform.
+// Returns the applied scale factor (1.0 if the vector was inside).
+float SVM_clip_to_hexagon(float* alpha, float* beta) {
+    float vA = *alpha;
+    float vB = -0.5f * *alpha + sqrt3_by_2 * *beta;
+    float vC = -0.5f * *alpha - sqrt3_by_2 * *beta;
+    float v_max = MACRO_MAX(vA, MACRO_MAX(vB, vC));
+    float v_min = MACRO_MIN(vA, MACRO_MIN(vB, vC));
+    float span = (2.0f / 3.0f) * (v_max - v_min);
+    if (!(span > 1.0f))
+        return 1.0f;
+    // A tiny margin keeps SVM() from rejecting the result due to rounding
+    float scale = 0.9999f / span;
+    *alpha *= scale;
+    *beta *= scale;
+    return scale;
+}
+
 // based on https://math.stackexchange.com/a/1105038/81278
 float fast_atan2(float y, float x) {
     // a := min (|x|, |y|) / max (|x|, |y|)
@@ -95,6 +95,23 @@ static inline float fmodf_pos(float x, float y) {
 // Returns 0 on success, and -1 if the input was out of range
 int SVM(float alpha, float beta, float* tA, float* tB, float* tC);
 
+// Discontinuous PWM modes (see DPWM())
+typedef enum {
+    DPWM_MODE_NONE = 0,  // continuous SVPWM
+    DPWM_MODE_MIN = 1,   // DPWMMIN: the lowest phase is clamped to the negative rail
+    DPWM_MODE_MAX = 2,   // DPWMMAX: the highest phase is clamped to the positive rail
+    DPWM_MODE_1 = 3,     // DPWM1: the phase with the largest current magnitude is clamped to its rail
+} DPWMMode_t;
+
+// Shifts the timings computed by SVM() to clamp one phase to a rail
+// I_alpha, I_beta is the current vector (only its direction is used by DPWM1)
+// Phases B and C are kept low for at least min_t_BC (fraction of the period)
+void DPWM(float alpha, float beta, float I_alpha, float I_beta, DPWMMode_t mode, float min_t_BC, float* tA, float* tB, float* tC);
+
+// Scales a modulation vector beyond the linear range onto the SVM hexagon
+// Returns the scale factor
+float SVM_clip_to_hexagon(float* alpha, float* beta);
+
 float fast_atan2(float y, float x);
 float horner_fma(float x, const float *coeffs, size_t count);
 int mod(int dividend, int divisor);
@@ -1,7 +1,8 @@
 /*
 * The ASCII protocol is a simpler, human readable alternative to the main native
 * protocol.
-* In the future this protocol might be extended to support selected GCode commands.
+* It also supports a small subset of GCode for motion, which is executed by the
+* on-device motion planner.
 * For a list of supported commands see doc/ascii-protocol.md
 */
 
@@ -13,6 +14,8 @@
 #include "ascii_protocol.hpp"
 #include <utils.h>
 #include <fibre/cpp_utils.hpp>
+#include <fibre/number_conversion.hpp>
+#include <cmath>
 
 /* Private macros ------------------------------------------------------------*/
 /* Private typedef -----------------------------------------------------------*/
@@ -21,63 +24,636 @@
 /* Private constant data -----------------------------------------------------*/
 
 #define MAX_LINE_LENGTH 256
-#define TO_STR_INNER(s) #s
-#define TO_STR(s) TO_STR_INNER(s)
+#define MAX_FEEDBACK_FIELDS 4
+#define MAX_NUMBER_LENGTH 18 // longest output of number_conversion::format_float, e.g. "-4294967295.999999"
+// A feedback stream line holds all fields of all axes, separated by spaces, plus the checksum ("*255")
+#define MAX_FEEDBACK_LENGTH (MAX_FEEDBACK_FIELDS * AXIS_COUNT * (MAX_NUMBER_LENGTH + 1) + 4)
+#define MAX_RESPONSE_LENGTH MACRO_MAX(128, MAX_FEEDBACK_LENGTH)
+#define MAX_COMPOUND_COMMANDS 8
+#define MAX_FEEDBACK_RATE 1000 // [Hz], limited by the 1ms tick of the communication threads
 
 /* Private variables ---------------------------------------------------------*/
+
+// @brief State of the feedback stream that is set up by the "fs" command.
+// It is written by the thread that receives the command and read by the
+// threads that serve the outputs, so it is only accessed as a whole, inside
+// a critical section (see configure_feedback_stream()).
+struct FeedbackStream_t {
+    StreamSink* output = nullptr; // nullptr if no stream is active
+    uint32_t generation = 0; // incremented on each change of the configuration
+    uint32_t period_ms = 0;
+    uint32_t deadline_ms = 0;
+    bool axes[AXIS_COUNT] = { false };
+    char fields[MAX_FEEDBACK_FIELDS + 1] = { 0 }; // null-terminated list of field identifiers
+    bool use_checksum = false;
+};
+static FeedbackStream_t feedback_stream;
+
+// @brief Modal state of the GCode interpreter
+static struct {
+    int motion_mode = -1; // 0 (G0) or 1 (G1), -1 if no motion command was received yet
+    bool relative = false; // G91
+    float feed_rate = 0.0f; // [units/min], 0 if no F word was received yet
+} gcode_state;
+static osMutexId gcode_mutex; // protects gcode_state
+
 /* Private function prototypes -----------------------------------------------*/
 /* Function implementations --------------------------------------------------*/
 
+void ASCII_protocol_init() {
+    osMutexDef(gcode_mutex);
+    gcode_mutex = osMutexCreate(osMutex(gcode_mutex));
+}
+
+// @brief Fixed size buffer to compose a response line without snprintf.
+// Output that doesn't fit is truncated.
+class ResponseLine {
+public:
+    void append(const char * str) {
+        while (*str && len_ < MAX_RESPONSE_LENGTH)
+            buffer_[len_++] = *(str++);
+    }
+    void append(char * str) { append(const_cast<const char *>(str)); }
+    void append(float value) {
+        len_ += number_conversion::format_float(value, buffer_ + len_, sizeof(buffer_) - len_);
+    }
+    void append(int32_t value) {
+        len_ += number_conversion::format_int(value, buffer_ + len_, sizeof(buffer_) - len_);
+    }
+    void append(uint32_t value) {
+        len_ += number_conversion::format_uint(value, buffer_ + len_, sizeof(buffer_) - len_);
+    }
+
+    // @brief Sends the line on the specified output, optionally followed by a checksum.
+    void send(StreamSink& output, bool include_checksum) {
+        if (include_checksum) {
+            uint8_t checksum = 0;
+            for (size_t i = 0; i < len_; ++i)
+                checksum ^= buffer_[i];
+            append("*");
+            append((uint32_t)checksum);
+        }
+        output.process_bytes((uint8_t*)buffer_, len_, nullptr); // TODO: use process_all instead
+        output.process_bytes((const uint8_t*)"\r\n", 2, nullptr);
+    }
+
+private:
+    char buffer_[MAX_RESPONSE_LENGTH + 1]; // +1 for the null-terminator written by number_conversion
+    size_t len_ = 0;
+};
+
+static void compose_response(ResponseLine& line) {}
+
+template<typename T, typename ... TArgs>
+static void compose_response(ResponseLine& line, T&& arg, TArgs&& ... args) {
+    line.append(arg);
+    compose_response(line, std::forward<TArgs>(args)...);
+}
+
 // @brief Sends a line on the specified output.
+// The line is the concatenation of all arguments, which can be strings, floats or integers.
 template<typename ... TArgs>
-void respond(StreamSink& output, bool include_checksum, const char * fmt, TArgs&& ... args) {
-    char response[64];
-    size_t len = snprintf(response, sizeof(response), fmt, std::forward<TArgs>(args)...);
-    output.process_bytes((uint8_t*)response, len, nullptr); // TODO: use process_all instead
-    if (include_checksum) {
-        uint8_t checksum = 0;
-        for (size_t i = 0; i < len; ++i)
-            checksum ^= response[i];
-        len = snprintf(response, sizeof(response), "*%u", checksum);
-        output.process_bytes((uint8_t*)response, len, nullptr);
-    }
-    output.process_bytes((const uint8_t*)"\r\n", 2, nullptr);
+void respond(StreamSink& output, bool include_checksum, TArgs&& ... args) {
+    ResponseLine line;
+    compose_response(line, std::forward<TArgs>(args)...);
+    line.send(output, include_checksum);
+}
+
+// @brief Splits a command line into whitespace separated tokens.
+// The tokens are null-terminated in-place, so no copy of the line is needed.
+class Tokenizer {
+public:
+    Tokenizer(char* buffer, size_t length) : pos_(buffer), end_(buffer + length) {}
+
+    // @brief Returns the next token or nullptr if there are no more tokens.
+    char* next(size_t* length = nullptr) {
+        while (pos_ < end_ && number_conversion::is_space(*pos_))
+            ++pos_;
+        if (pos_ >= end_)
+            return nullptr;
+        char* token = pos_;
+        while (pos_ < end_ && !number_conversion::is_space(*pos_))
+            ++pos_;
+        if (length)
+            *length = pos_ - token;
+        if (pos_ < end_)
+            *(pos_++) = 0;
+        return token;
+    }
+
+    // @brief Parses the next token as number. Fails if the token is not
+    // entirely a number.
+    bool next_value(uint32_t* value) {
+        size_t length;
+        char* token = next(&length);
+        return token && number_conversion::parse_uint(token, length, value) == length;
+    }
+    bool next_value(float* value) {
+        size_t length;
+        char* token = next(&length);
+        return token && number_conversion::parse_float(token, length, value) == length;
+    }
+
+private:
+    char* pos_;
+    char* end_;
+};
+
+static int scan_tokens(Tokenizer& tokenizer) {
+    return 0;
+}
+
+// @brief Parses consecutive tokens into the specified variables, similar to sscanf.
+// @returns the number of variables that were successfully parsed
+template<typename T, typename ... Ts>
+static int scan_tokens(Tokenizer& tokenizer, T* value, Ts* ... values) {
+    if (!tokenizer.next_value(value))
+        return 0;
+    return 1 + scan_tokens(tokenizer, values...);
+}
+
+
+// @brief Returns true if the character identifies a field that can be
+// included in the feedback stream.
+static bool is_feedback_field(char field) {
+    return field == 'p' || field == 'v' || field == 'i' || field == 's' || field == 'e';
+}
+
+static void append_feedback_field(ResponseLine& line, Axis& axis, char field) {
+    switch (field) {
+        case 'p': line.append(axis.encoder_.pos_estimate_); break;
+        case 'v': line.append(axis.encoder_.vel_estimate_); break;
+        case 'i': line.append(axis.motor_.current_control_.Iq_measured); break;
+        case 's': line.append((uint32_t)axis.current_state_); break;
+        case 'e': line.append((uint32_t)axis.error_); break;
+    }
+}
+
+// @brief Replaces the feedback stream configuration.
+// The configuration is published as a whole, so a reader never sees a mix of
+// the old and new configuration.
+static void publish_feedback_stream(FeedbackStream_t& config) {
+    uint32_t prim = cpu_enter_critical();
+    config.generation = feedback_stream.generation + 1;
+    feedback_stream = config;
+    cpu_exit_critical(prim);
+}
+
+// @brief Sets up or cancels the feedback stream ("fs" command).
+// Syntax: fs rate [axes [fields]]
+static void configure_feedback_stream(Tokenizer& tokenizer, StreamSink& response_channel, bool use_checksum) {
+    FeedbackStream_t config;
+
+    size_t rate_len;
+    const char* rate_str = tokenizer.next(&rate_len);
+    uint32_t rate = 0; // "fs" without arguments cancels the stream
+    if (rate_str && number_conversion::parse_uint(rate_str, rate_len, &rate) != rate_len) {
+        respond(response_channel, use_checksum, "invalid rate");
+        return;
+    }
+    if (rate == 0) {
+        publish_feedback_stream(config);
+        return;
+    }
+    if (rate > MAX_FEEDBACK_RATE) {
+        respond(response_channel, use_checksum, "invalid rate");
+        return;
+    }
+
+    bool axes[AXIS_COUNT];
+    const char* axes_str = tokenizer.next();
+    for (size_t i = 0; i < AXIS_COUNT; ++i)
+        axes[i] = !axes_str; // default: all axes
+    for (const char* c = axes_str; c && *c; ++c) {
+        size_t axis_number = *c - '0';
+        if (axis_number >= AXIS_COUNT) {
+            respond(response_channel, use_checksum, "invalid axes");
+            return;
+        }
+        axes[axis_number] = true;
+    }
+
+    size_t fields_len;
+    const char* fields = tokenizer.next(&fields_len);
+    if (!fields) {
+        fields = "pv"; // default: same fields as the "f" command
+        fields_len = 2;
+    }
+    if (fields_len > MAX_FEEDBACK_FIELDS) {
+        respond(response_channel, use_checksum, "too many fields");
+        return;
+    }
+    for (size_t i = 0; i < fields_len; ++i) {
+        if (!is_feedback_field(fields[i])) {
+            respond(response_channel, use_checksum, "invalid field");
+            return;
+        }
+    }
+
+    for (size_t i = 0; i < AXIS_COUNT; ++i)
+        config.axes[i] = axes[i];
+    memcpy(config.fields, fields, fields_len);
+    config.fields[fields_len] = 0;
+    config.period_ms = 1000 / rate;
+    config.use_checksum = use_checksum;
+    config.deadline_ms = timeout_to_deadline(0);
+    config.output = &response_channel;
+    publish_feedback_stream(config);
 }
 
+// @brief Sends a feedback line on the specified output if a feedback stream
+// is active on this output and the next line is due.
+// Must be called periodically (at least once per millisecond for the highest rate)
+// by the thread that serves the output.
+// @returns the time in ms until the next line is due or osWaitForever if no
+//          feedback stream is active on this output.
+uint32_t ASCII_protocol_stream_feedback(StreamSink& output) {
+    uint32_t prim = cpu_enter_critical();
+    FeedbackStream_t stream = feedback_stream;
+    cpu_exit_critical(prim);
+
+    if (stream.output != &output)
+        return osWaitForever;
+
+    uint32_t timeout = deadline_to_timeout(stream.deadline_ms);
+    if (timeout)
+        return timeout;
+
+    stream.deadline_ms += stream.period_ms;
+    if (!is_in_the_future(stream.deadline_ms))
+        stream.deadline_ms = timeout_to_deadline(stream.period_ms); // fast-forward if we fell behind
+
+    // Only this thread advances the deadline, unless the stream was reconfigured in the meantime
+    prim = cpu_enter_critical();
+    if (feedback_stream.generation == stream.generation)
+        feedback_stream.deadline_ms = stream.deadline_ms;
+    cpu_exit_critical(prim);
+
+    ResponseLine line;
+    bool first = true;
+    for (size_t i = 0; i < AXIS_COUNT; ++i) {
+        if (!stream.axes[i])
+            continue;
+        for (const char* field = stream.fields; *field; ++field) {
+            if (!first)
+                line.append(" ");
+            append_feedback_field(line, *axes[i], *field);
+            first = false;
+        }
+    }
+    line.send(output, stream.use_checksum);
+
+    return deadline_to_timeout(stream.deadline_ms);
+}
+
+// @brief Setpoint command for a single axis (p, q, v, c, t or u).
+// The command is fully parsed and validated before it is applied.
+struct AxisCommand {
+    char type;
+    uint32_t motor_number;
+    float values[3];
+    int numscan; // number of successfully parsed arguments, including the motor number
+};
+
+static bool is_axis_command(char type) {
+    return type == 'p' || type == 'q' || type == 'v' || type == 'c' || type == 't' || type == 'u';
+}
+
+// @brief Parses the arguments of an axis command.
+// @returns false if the arguments are invalid. In this case an error message
+//          is sent on the response channel.
+static bool parse_axis_command(char type, Tokenizer& tokenizer, AxisCommand* command, StreamSink& response_channel, bool use_checksum) {
+    command->type = type;
+    command->numscan = scan_tokens(tokenizer, &command->motor_number, &command->values[0], &command->values[1], &command->values[2]);
+    int min_numscan = (type == 'u') ? 1 : 2;
+    if (command->numscan < min_numscan) {
+        respond(response_channel, use_checksum, "invalid command format");
+        return false;
+    } else if (command->motor_number >= AXIS_COUNT) {
+        respond(response_channel, use_checksum, "invalid motor ", command->motor_number);
+        return false;
+    }
+    return true;
+}
+
+// @brief Applies the setpoints of a command that was parsed by parse_axis_command
+static void apply_axis_setpoints(const AxisCommand& command) {
+    Axis* axis = axes[command.motor_number];
+    const float* values = command.values;
+    switch (command.type) {
+        case 'p': { // position control
+            float vel_feed_forward = (command.numscan >= 3) ? values[1] : 0.0f;
+            float current_feed_forward = (command.numscan >= 4) ? values[2] : 0.0f;
+            axis->controller_.set_pos_setpoint(values[0], vel_feed_forward, current_feed_forward);
+        } break;
+        case 'q': { // position control with limits
+            axis->controller_.pos_setpoint_ = values[0];
+            if (command.numscan >= 3)
+                axis->controller_.config_.vel_limit = values[1];
+            if (command.numscan >= 4)
+                axis->motor_.config_.current_lim = values[2];
+        } break;
+        case 'v': { // velocity control
+            float current_feed_forward = (command.numscan >= 3) ? values[1] : 0.0f;
+            axis->controller_.set_vel_setpoint(values[0], current_feed_forward);
+        } break;
+        case 'c': { // current control
+            axis->controller_.set_current_setpoint(values[0]);
+        } break;
+        case 't': { // trapezoidal trajectory
+            axis->controller_.move_to_pos(values[0]);
+        } break;
+        case 'u': // update axis watchdog only
+        default: break;
+    }
+}
+
+// @brief Applies a command that was parsed by parse_axis_command and feeds
+// the watchdog of the corresponding axis.
+static void apply_axis_command(const AxisCommand& command) {
+    apply_axis_setpoints(command);
+    axes[command.motor_number]->watchdog_feed();
+}
+
+// @brief Parses the arguments of a feedback request ("f motor").
+static bool parse_feedback_command(Tokenizer& tokenizer, uint32_t* motor_number, StreamSink& response_channel, bool use_checksum) {
+    if (scan_tokens(tokenizer, motor_number) < 1) {
+        respond(response_channel, use_checksum, "invalid command format");
+        return false;
+    } else if (*motor_number >= AXIS_COUNT) {
+        respond(response_channel, use_checksum, "invalid motor ", *motor_number);
+        return false;
+    }
+    return true;
+}
+
+static void append_feedback(ResponseLine& line, Axis& axis) {
+    line.append(axis.encoder_.pos_estimate_);
+    line.append(" ");
+    line.append(axis.encoder_.vel_estimate_);
+}
+
+// @brief Executes a line that consists of several commands separated by '&',
+// for example "p 0 1000 & p 1 -1000 & f 0 & f 1".
+//
+// Only axis commands (p, q, v, c, t, u) and feedback requests (f) can be combined.
+// All commands are parsed and validated before any of them is applied. If one
+// of them is invalid, none of them is applied.
+// The setpoints are applied in a critical section, so that the control loops
+// see either none or all of them. Trajectories (t) are planned beforehand,
+// starting from the setpoints that the preceding commands of the line leave,
+// so that the critical section only swaps them in. The feedback of all f
+// requests is sent afterwards on a single line, in the order of the requests.
+static void process_compound_line(char* cmd, size_t len, StreamSink& response_channel, bool use_checksum) {
+    AxisCommand commands[MAX_COMPOUND_COMMANDS];
+    size_t n_commands = 0;
+    uint32_t feedback_requests[MAX_COMPOUND_COMMANDS];
+    size_t n_feedback_requests = 0;
+
+    char* end = cmd + len;
+    for (char* segment = cmd; segment <= end; ) {
+        char* segment_end = static_cast<char*>(memchr(segment, '&', end - segment));
+        if (!segment_end)
+            segment_end = end;
+        *segment_end = 0;
+
+        while (segment < segment_end && number_conversion::is_space(*segment))
+            ++segment;
+        char type = (segment < segment_end) ? *segment : 0;
+        Tokenizer tokenizer(segment + 1, segment < segment_end ? segment_end - segment - 1 : 0);
+
+        if (n_commands + n_feedback_requests >= MAX_COMPOUND_COMMANDS) {
+            respond(response_channel, use_checksum, "too many commands");
+            return;
+        } else if (is_axis_command(type)) {
+            if (!parse_axis_command(type, tokenizer, &commands[n_commands++], response_channel, use_checksum))
+                return;
+        } else if (type == 'f') {
+            if (!parse_feedback_command(tokenizer, &feedback_requests[n_feedback_requests++], response_channel, use_checksum))
+                return;
+        } else {
+            respond(response_channel, use_checksum, "invalid command format");
+            return;
+        }
+
+        segment = segment_end + 1;
+    }
+
+    // Plan the trajectories. Only the last t command of an axis takes effect,
+    // because a later one replaces the trajectory and the control mode.
+    TrapezoidalTrajectory::Config_t plan_config; // the limits are passed explicitly
+    TrapezoidalTrajectory plans[AXIS_COUNT] = { TrapezoidalTrajectory(plan_config), TrapezoidalTrajectory(plan_config) };
+    size_t last_trajectory[AXIS_COUNT];
+    float start_pos[AXIS_COUNT], start_vel[AXIS_COUNT];
+    for (size_t i = 0; i < AXIS_COUNT; ++i) {
+        last_trajectory[i] = n_commands;
+        start_pos[i] = axes[i]->controller_.pos_setpoint_;
+        start_vel[i] = axes[i]->controller_.vel_setpoint_;
+    }
+    for (size_t i = 0; i < n_commands; ++i) {
+        const AxisCommand& command = commands[i];
+        size_t motor = command.motor_number;
+        if (command.type == 'p') {
+            start_pos[motor] = command.values[0];
+            start_vel[motor] = (command.numscan >= 3) ? command.values[1] : 0.0f;
+        } else if (command.type == 'q') {
+            start_pos[motor] = command.values[0];
+        } else if (command.type == 'v') {
+            start_vel[motor] = command.values[0];
+        } else if (command.type == 't') {
+            TrapezoidalTrajectory::Config_t& limits = axes[motor]->trap_.config_;
+            plans[motor].planTrapezoidal(command.values[0], start_pos[motor], start_vel[motor],
+                                         limits.vel_limit, limits.accel_limit, limits.decel_limit);
+            last_trajectory[motor] = i;
+        }
+    }
+
+    uint32_t mask = cpu_enter_critical();
+    for (size_t i = 0; i < n_commands; ++i) {
+        const AxisCommand& command = commands[i];
+        if (command.type != 't') {
+            apply_axis_setpoints(command);
+        } else if (last_trajectory[command.motor_number] == i) {
+            Axis* axis = axes[command.motor_number];
+            axis->trap_.set_plan(plans[command.motor_number]);
+            axis->controller_.start_trajectory(command.values[0]);
+        }
+    }
+    cpu_exit_critical(mask);
+
+    for (size_t i = 0; i < n_commands; ++i)
+        axes[commands[i].motor_number]->watchdog_feed();
+
+    if (n_feedback_requests) {
+        ResponseLine line;
+        for (size_t i = 0; i < n_feedback_requests; ++i) {
+            if (i)
+                line.append(" ");
+            append_feedback(line, *axes[feedback_requests[i]]);
+        }
+        line.send(response_channel, use_checksum);
+    }
+}
+
+// @brief Returns the GCode word index of an axis letter or -1 if the letter
+// isn't an axis.
+static int gcode_axis_index(char letter) {
+    if (letter == 'X')
+        return 0;
+    if (letter == 'Y')
+        return 1;
+    return -1;
+}
+
+// @brief Executes a line of GCode, for example "G1 X10 Y-5.5 F600".
+//
+// Supported words: G0, G1, G4, G90, G91, M17, M18, M84, X, Y, F, P, S, N.
+// Each line can produce at most one queued block. Lines are answered with
+// "ok" once the block was queued, so a sender can stream ahead of the
+// execution until the queue is full.
+// @returns the response line
+static const char* execute_gcode_line(char* cmd, size_t len) {
+    MotionPlanner::Block_t block = {};
+    int g_command = -1;
+    int m_command = -1;
+    bool has_axis_words = false;
+    float dwell_p = -1.0f, dwell_s = -1.0f;
+    float feed_rate = gcode_state.feed_rate;
+    bool relative = gcode_state.relative;
+
+    // Read all words of the line
+    const char* end = cmd + len;
+    for (const char* pos = cmd; pos < end; ) {
+        if (number_conversion::is_space(*pos)) {
+            ++pos;
+            continue;
+        }
+        if (*pos == '(') { // skip comment
+            while (pos < end && *pos != ')')
+                ++pos;
+            ++pos;
+            continue;
+        }
+        char letter = *pos++;
+        if (letter >= 'a' && letter <= 'z')
+            letter -= 'a' - 'A';
+        float value;
+        size_t consumed = number_conversion::parse_float(pos, end - pos, &value);
+        if (!consumed || !std::isfinite(value)) {
+            return "error: invalid word";
+        }
+        pos += consumed;
+
+        int axis_index = gcode_axis_index(letter);
+        if (letter == 'G' && value == 90.0f) {
+            relative = false;
+        } else if (letter == 'G' && value == 91.0f) {
+            relative = true;
+        } else if (letter == 'G' && g_command < 0 && (value == 0.0f || value == 1.0f || value == 4.0f)) {
+            g_command = (int)value;
+        } else if (letter == 'M' && m_command < 0 && (value == 17.0f || value == 18.0f || value == 84.0f)) {
+            m_command = (int)value;
+        } else if (axis_index >= 0) {
+            block.has_target[axis_index] = true;
+            block.target[axis_index] = value;
+            has_axis_words = true;
+        } else if (letter == 'F') {
+            if (value <= 0.0f)
+                return "error: invalid feed rate";
+            feed_rate = value;
+        } else if (letter == 'P') {
+            dwell_p = value;
+        } else if (letter == 'S') {
+            dwell_s = value;
+        } else if (letter == 'N') {
+            // line number, ignored
+        } else {
+            return "error: unsupported word";
+        }
+    }
+
+    // Axis words without G command continue the previous motion mode
+    if (g_command < 0 && has_axis_words)
+        g_command = gcode_state.motion_mode;
+
+    bool has_block = true;
+    if (m_command >= 0 && (g_command >= 0 || has_axis_words)) {
+        return "error: too many commands";
+    } else if (m_command == 17) {
+        block.type = MotionPlanner::BLOCK_TYPE_ENABLE;
+    } else if (m_command == 18 || m_command == 84) {
+        block.type = MotionPlanner::BLOCK_TYPE_DISABLE;
+    } else if (g_command == 4) {
+        if (has_axis_words || (dwell_p < 0.0f && dwell_s < 0.0f)) {
+            return "error: invalid dwell";
+        }
+        block.type = MotionPlanner::BLOCK_TYPE_DWELL;
+        block.dwell_ms = (uint32_t)(dwell_p >= 0.0f ? dwell_p : dwell_s * 1000.0f);
+    } else if (g_command == 0 || g_command == 1) {
+        if (g_command == 1 && feed_rate <= 0.0f) {
+            return "error: no feed rate";
+        }
+        block.type = MotionPlanner::BLOCK_TYPE_MOVE;
+        block.relative = relative;
+        block.feed_rate = (g_command == 0) ? INFINITY : feed_rate;
+        has_block = has_axis_words;
+    } else if (has_axis_words) {
+        return "error: no motion mode";
+    } else {
+        has_block = false; // only modal words (e.g. G91 or F)
+    }
+
+    if (has_block && !motion_planner->enqueue(block)) {
+        return "error: queue full";
+    }
+
+    // Modal state is only updated if the line was accepted
+    gcode_state.relative = relative;
+    gcode_state.feed_rate = feed_rate;
+    if (g_command == 0 || g_command == 1)
+        gcode_state.motion_mode = g_command;
+    return "ok";
+}
+
+static void process_gcode_line(char* cmd, size_t len, StreamSink& response_channel, bool use_checksum) {
+    // The UART and USB threads can both send GCode
+    osMutexWait(gcode_mutex, osWaitForever);
+    const char* response = execute_gcode_line(cmd, len);
+    osMutexRelease(gcode_mutex);
+    respond(response_channel, use_checksum, response);
+}
 
 // @brief Executes an ASCII protocol command
-// @param buffer buffer of ASCII encoded characters
+// @param buffer buffer of ASCII encoded characters. The buffer must have space
+//        for at least len + 1 characters. It is modified during parsing.
 // @param len size of the buffer
-void ASCII_protocol_process_line(const uint8_t* buffer, size_t len, StreamSink& response_channel) {
+void ASCII_protocol_process_line(uint8_t* buffer, size_t len, StreamSink& response_channel) {
     static_assert(sizeof(char) == sizeof(uint8_t));
+    char* cmd = reinterpret_cast<char*>(buffer);
 
     // scan line to find beginning of checksum and prune comment
     uint8_t checksum = 0;
     size_t checksum_start = SIZE_MAX;
     for (size_t i = 0; i < len; ++i) {
-        if (buffer[i] == ';') { // ';' is the comment start char
+        if (cmd[i] == ';') { // ';' is the comment start char
             len = i;
             break;
         }
         if (checksum_start > i) {
-            if (buffer[i] == '*') {
+            if (cmd[i] == '*') {
                 checksum_start = i + 1;
             } else {
-                checksum ^= buffer[i];
+                checksum ^= cmd[i];
             }
         }
     }
 
-    // copy everything into a local buffer so we can insert null-termination
-    char cmd[MAX_LINE_LENGTH + 1];
-    if (len > MAX_LINE_LENGTH) len = MAX_LINE_LENGTH;
-    memcpy(cmd, buffer, len);
-
     // optional checksum validation
     bool use_checksum = (checksum_start < len);
     if (use_checksum) {
-        unsigned int received_checksum;
-        sscanf((const char *)cmd + checksum_start, "%u", &received_checksum);
+        uint32_t received_checksum;
+        if (!number_conversion::parse_uint(cmd + checksum_start, len - checksum_start, &received_checksum))
+            return;
         if (received_checksum != checksum)
             return;
         len = checksum_start - 1; // prune checksum and asterisk
@@ -85,99 +661,31 @@ void ASCII_protocol_process_line(const uint8_t* buffer, size_t len, StreamSink&
 
     cmd[len] = 0; // null-terminate
 
-    // check incoming packet type
-    if (cmd[0] == 'p') { // position control
-        unsigned motor_number;
-        float pos_setpoint, vel_feed_forward, current_feed_forward;
-        int numscan = sscanf(cmd, "p %u %f %f %f", &motor_number, &pos_setpoint, &vel_feed_forward, &current_feed_forward);
-        if (numscan < 2) {
-            respond(response_channel, use_checksum, "invalid command format");
-        } else if (motor_number >= AXIS_COUNT) {
-            respond(response_channel, use_checksum, "invalid motor %u", motor_number);
-        } else {
-            if (numscan < 3)
-                vel_feed_forward = 0.0f;
-            if (numscan < 4)
-                current_feed_forward = 0.0f;
-            Axis* axis = axes[motor_number];
-            axis->controller_.set_pos_setpoint(pos_setpoint, vel_feed_forward, current_feed_forward);
-            axis->watchdog_feed();
-        }
+    // arguments start after the command character
+    Tokenizer tokenizer(cmd + (len ? 1 : 0), len ? len - 1 : 0);
 
-    } else if (cmd[0] == 'q') { // position control with limits
-        unsigned motor_number;
-        float pos_setpoint, vel_limit, current_lim;
-        int numscan = sscanf(cmd, "q %u %f %f %f", &motor_number, &pos_setpoint, &vel_limit, &current_lim);
-        if (numscan < 2) {
-            respond(response_channel, use_checksum, "invalid command format");
-        } else if (motor_number >= AXIS_COUNT) {
-            respond(response_channel, use_checksum, "invalid motor %u", motor_number);
-        } else {
-            Axis* axis = axes[motor_number];
-            axis->controller_.pos_setpoint_ = pos_setpoint;
-            if (numscan >= 3)
-                axis->controller_.config_.vel_limit = vel_limit;
-            if (numscan >= 4)
-                axis->motor_.config_.current_lim = current_lim;
-
-            axis->watchdog_feed();
-        }
+    // check incoming packet type
+    if (memchr(cmd, '&', len)) { // compound command
+        process_compound_line(cmd, len, response_channel, use_checksum);
 
-    } else if (cmd[0] == 'v') { // velocity control
-        unsigned motor_number;
-        float vel_setpoint, current_feed_forward;
-        int numscan = sscanf(cmd, "v %u %f %f", &motor_number, &vel_setpoint, &current_feed_forward);
-        if (numscan < 2) {
-            respond(response_channel, use_checksum, "invalid command format");
-        } else if (motor_number >= AXIS_COUNT) {
-            respond(response_channel, use_checksum, "invalid motor %u", motor_number);
-        } else {
-            if (numscan < 3)
-                current_feed_forward = 0.0f;
-            Axis* axis = axes[motor_number];
-            axis->controller_.set_vel_setpoint(vel_setpoint, current_feed_forward);
-            axis->watchdog_feed();
-        }
+    } else if (cmd[0] == 'G' || cmd[0] == 'M' || cmd[0] == 'N') { // GCode
+        process_gcode_line(cmd, len, response_channel, use_checksum);
 
-    } else if (cmd[0] == 'c') { // current control
-        unsigned motor_number;
-        float current_setpoint;
-        int numscan = sscanf(cmd, "c %u %f", &motor_number, &current_setpoint);
-        if (numscan < 2) {
-            respond(response_channel, use_checksum, "invalid command format");
-        } else if (motor_number >= AXIS_COUNT) {
-            respond(response_channel, use_checksum, "invalid motor %u", motor_number);
-        } else {
-            Axis* axis = axes[motor_number];
-            axis->controller_.set_current_setpoint(current_setpoint);
-            axis->watchdog_feed();
-        }
+    } else if (is_axis_command(cmd[0])) { // p, q, v, c, t or u
+        AxisCommand command;
+        if (parse_axis_command(cmd[0], tokenizer, &command, response_channel, use_checksum))
+            apply_axis_command(command);
 
-    } else if (cmd[0] == 't') { // trapezoidal trajectory
-        unsigned motor_number;
-        float goal_point;
-        int numscan = sscanf(cmd, "t %u %f", &motor_number, &goal_point);
-        if (numscan < 2) {
-            respond(response_channel, use_checksum, "invalid command format");
-        } else if (motor_number >= AXIS_COUNT) {
-            respond(response_channel, use_checksum, "invalid motor %u", motor_number);
-        } else {
-            Axis* axis = axes[motor_number];
-            axis->controller_.move_to_pos(goal_point);
-            axis->watchdog_feed();
-        }
+    } else if (cmd[0] == 'f' && cmd[1] == 's') { // feedback stream
+        Tokenizer stream_tokenizer(cmd + 2, len - 2);
+        configure_feedback_stream(stream_tokenizer, response_channel, use_checksum);
 
     } else if (cmd[0] == 'f') { // feedback
-        unsigned motor_number;
-        int numscan = sscanf(cmd, "f %u", &motor_number);
-        if (numscan < 1) {
-            respond(response_channel, use_checksum, "invalid command format");
-        } else if (motor_number >= AXIS_COUNT) {
-            respond(response_channel, use_checksum, "invalid motor %u", motor_number);
-        } else {
-            respond(response_channel, use_checksum, "%f %f",
-                    (double)axes[motor_number]->encoder_.pos_estimate_,
-                    (double)axes[motor_number]->encoder_.vel_estimate_);
+        uint32_t motor_number;
+        if (parse_feedback_command(tokenizer, &motor_number, response_channel, use_checksum)) {
+            ResponseLine line;
+            append_feedback(line, *axes[motor_number]);
+            line.send(response_channel, use_checksum);
         }
 
     } else if (cmd[0] == 'h') {  // Help
@@ -188,6 +696,11 @@ void ASCII_protocol_process_line(const uint8_t* buffer, size_t len, StreamSink&
         respond(response_channel, use_checksum, "Position: p axis pos vel-ff I-ff");
         respond(response_channel, use_checksum, "Velocity: v axis vel I-ff");
         respond(response_channel, use_checksum, "Current: c axis I");
+        respond(response_channel, use_checksum, "Feedback: f axis");
+        respond(response_channel, use_checksum, "Feedback stream: fs rate axes fields");
+        respond(response_channel, use_checksum, "Watchdog: u axis");
+        respond(response_channel, use_checksum, "Combined: p 0 pos & p 1 pos & f 0 & f 1");
+        respond(response_channel, use_checksum, "GCode: G0, G1, G4, G90, G91, M17, M18");
         respond(response_channel, use_checksum, "");
         respond(response_channel, use_checksum, "Properties start at odrive root, such as axis0.requested_state");
         respond(response_channel, use_checksum, "Read: r property");
@@ -201,9 +714,12 @@ void ASCII_protocol_process_line(const uint8_t* buffer, size_t len, StreamSink&
         // respond(response_channel, use_checksum, "Signature: %#x", STM_ID_GetSignature());
         // respond(response_channel, use_checksum, "Revision: %#x", STM_ID_GetRevision());
         // respond(response_channel, use_checksum, "Flash Size: %#x KiB", STM_ID_GetFlashSize());
-        respond(response_channel, use_checksum, "Hardware version: %d.%d-%dV", HW_VERSION_MAJOR, HW_VERSION_MINOR, HW_VERSION_VOLTAGE);
-        respond(response_channel, use_checksum, "Firmware version: %d.%d.%d", FW_VERSION_MAJOR, FW_VERSION_MINOR, FW_VERSION_REVISION);
-        respond(response_channel, use_checksum, "Serial number: %s", serial_number_str);
+        // The version macros are plain int, which matches none of the append() overloads on ARM
+        respond(response_channel, use_checksum, "Hardware version: ", (uint32_t)HW_VERSION_MAJOR, ".",
+                (uint32_t)HW_VERSION_MINOR, "-", (uint32_t)HW_VERSION_VOLTAGE, "V");
+        respond(response_channel, use_checksum, "Firmware version: ", (uint32_t)FW_VERSION_MAJOR, ".",
+                (uint32_t)FW_VERSION_MINOR, ".", (uint32_t)FW_VERSION_REVISION);
+        respond(response_channel, use_checksum, "Serial number: ", serial_number_str);
 
     } else if (cmd[0] == 's'){ // System
         if(cmd[1] == 's') { // Save config
@@ -215,16 +731,15 @@ void ASCII_protocol_process_line(const uint8_t* buffer, size_t len, StreamSink&
         }
 
     } else if (cmd[0] == 'r') { // read property
-        char name[MAX_LINE_LENGTH];
-        int numscan = sscanf(cmd, "r %" TO_STR(MAX_LINE_LENGTH) "s", name);
-        if (numscan < 1) {
+        char* name = tokenizer.next();
+        if (!name) {
             respond(response_channel, use_checksum, "invalid command format");
         } else {
-            Endpoint* endpoint = application_endpoints_->get_by_name(name, sizeof(name));
+            Endpoint* endpoint = application_endpoints_->get_by_name(name, MAX_LINE_LENGTH);
             if (!endpoint) {
                 respond(response_channel, use_checksum, "invalid property");
             } else {
-                char response[10];
+                char response[MAX_RESPONSE_LENGTH];
                 bool success = endpoint->get_string(response, sizeof(response));
                 if (!success)
                     respond(response_channel, use_checksum, "not implemented");
@@ -234,40 +749,29 @@ void ASCII_protocol_process_line(const uint8_t* buffer, size_t len, StreamSink&
         }
 
     } else if (cmd[0] == 'w') { // write property
-        char name[MAX_LINE_LENGTH];
-        char value[MAX_LINE_LENGTH];
-        int numscan = sscanf(cmd, "w %" TO_STR(MAX_LINE_LENGTH) "s %" TO_STR(MAX_LINE_LENGTH) "s", name, value);
-        if (numscan < 1) {
+        char* name = tokenizer.next();
+        size_t value_len;
+        char* value = tokenizer.next(&value_len);
+        if (!name || !value) {
             respond(response_channel, use_checksum, "invalid command format");
         } else {
-            Endpoint* endpoint = application_endpoints_->get_by_name(name, sizeof(name));
+            Endpoint* endpoint = application_endpoints_->get_by_name(name, MAX_LINE_LENGTH);
             if (!endpoint) {
                 respond(response_channel, use_checksum, "invalid property");
             } else {
-                bool success = endpoint->set_string(value, sizeof(value));
+                bool success = endpoint->set_string(value, value_len);
                 if (!success)
                     respond(response_channel, use_checksum, "not implemented");
             }
         }
 
-    }else if (cmd[0] == 'u') { // Update axis watchdog. 
-        unsigned motor_number;
-        int numscan = sscanf(cmd, "u %u", &motor_number);
-        if(numscan < 1){
-            respond(response_channel, use_checksum, "invalid command format");
-        } else if (motor_number >= AXIS_COUNT) {
-            respond(response_channel, use_checksum, "invalid motor %u", motor_number);
-        }else {
-            axes[motor_number]->watchdog_feed();
-        }
-
     } else if (cmd[0] != 0) {
         respond(response_channel, use_checksum, "unknown command");
     }
 }
 
 void ASCII_protocol_parse_stream(const uint8_t* buffer, size_t len, StreamSink& response_channel) {
-    static uint8_t parse_buffer[MAX_LINE_LENGTH];
+    static uint8_t parse_buffer[MAX_LINE_LENGTH + 1]; // +1 for null-termination
     static bool read_active = true;
     static uint32_t parse_buffer_idx = 0;
 
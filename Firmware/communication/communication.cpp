@@ -7,6 +7,7 @@
 #include "interface_uart.h"
 #include "interface_can.hpp"
 #include "interface_i2c.h"
+#include "ascii_protocol.hpp"
 
 #include "odrive_main.h"
 #include "freertos_vars.h"
@@ -70,11 +71,17 @@ static uint32_t test_property = 0;
 
 /* Private function prototypes -----------------------------------------------*/
 
-auto make_protocol_definitions(PWMMapping_t& mapping) {
+auto make_protocol_definitions(PWMMapping_t& mapping, InputMapping& input_mapping) {
     return make_protocol_member_list(
-        make_protocol_property("endpoint", &mapping.endpoint),
+        make_protocol_property("endpoint", &mapping.endpoint,
+            [](void* ctx) { static_cast<InputMapping*>(ctx)->resolve_endpoint(); }, &input_mapping),
         make_protocol_property("min", &mapping.min),
-        make_protocol_property("max", &mapping.max)
+        make_protocol_property("max", &mapping.max),
+        make_protocol_property("median_filter", &mapping.median_filter),
+        make_protocol_property("filter_bandwidth", &mapping.filter_bandwidth),
+        make_protocol_property("deadband", &mapping.deadband),
+        make_protocol_property("rate_limit", &mapping.rate_limit),
+        make_protocol_ro_property("value", &input_mapping.value_)
     );
 }
 
@@ -83,6 +90,8 @@ auto make_protocol_definitions(PWMMapping_t& mapping) {
 void init_communication(void) {
     printf("hi!\r\n");
 
+    ASCII_protocol_init();
+
     // Start command handling thread
     osThreadDef(task_cmd_parse, communication_task, osPriorityNormal, 0, 8000 /* in 32-bit words */); // TODO: fix stack issues
     comm_thread = osThreadCreate(osThread(task_cmd_parse), NULL);
@@ -109,6 +118,8 @@ public:
     void enter_dfu_mode_helper() { enter_dfu_mode(); }
     float get_oscilloscope_val(uint32_t index) { return oscilloscope[index]; }
     float get_adc_voltage_(uint32_t gpio) { return get_adc_voltage(get_gpio_port_by_pin(gpio), get_gpio_pin_by_pin(gpio)); }
+    float get_adc_filter_bandwidth(uint32_t channel) { return channel < ADC_CHANNEL_COUNT ? board_config.adc_filter_bandwidth[channel] : 0.0f; }
+    void set_adc_filter_bandwidth(uint32_t channel, float bandwidth) { if (channel < ADC_CHANNEL_COUNT) board_config.adc_filter_bandwidth[channel] = bandwidth; }
     int32_t test_function(int32_t delta) { static int cnt = 0; return cnt += delta; }
 } static_functions;
 
@@ -128,6 +139,8 @@ static inline auto make_obj_tree() {
         make_protocol_ro_property("fw_version_unreleased", &fw_version_unreleased),
         make_protocol_ro_property("user_config_loaded", const_cast<const bool *>(&user_config_loaded_)),
         make_protocol_ro_property("brake_resistor_armed", &brake_resistor_armed),
+        make_protocol_ro_property("regen_current_allowed", &regen_current_allowed),
+        make_protocol_ro_property("adc_timestamp", &adc_timestamp_),
         make_protocol_object("system_stats",
             make_protocol_ro_property("uptime", &system_stats_.uptime),
             make_protocol_ro_property("min_heap_space", &system_stats_.min_heap_space),
@@ -158,23 +171,31 @@ static inline auto make_obj_tree() {
             make_protocol_property("enable_ascii_protocol_on_usb", &board_config.enable_ascii_protocol_on_usb),
             make_protocol_property("dc_bus_undervoltage_trip_level", &board_config.dc_bus_undervoltage_trip_level),
             make_protocol_property("dc_bus_overvoltage_trip_level", &board_config.dc_bus_overvoltage_trip_level),
+            make_protocol_property("enable_dc_bus_voltage_regulation", &board_config.enable_dc_bus_voltage_regulation),
+            make_protocol_property("dc_bus_overvoltage_ramp_start", &board_config.dc_bus_overvoltage_ramp_start),
+            make_protocol_property("dc_bus_overvoltage_ramp_end", &board_config.dc_bus_overvoltage_ramp_end),
+            make_protocol_property("dc_bus_voltage_regulation_gain", &board_config.dc_bus_voltage_regulation_gain),
+            make_protocol_property("max_regen_current", &board_config.max_regen_current),
 #if HW_VERSION_MAJOR == 3 && HW_VERSION_MINOR >= 3
-            make_protocol_object("gpio1_pwm_mapping", make_protocol_definitions(board_config.pwm_mappings[0])),
-            make_protocol_object("gpio2_pwm_mapping", make_protocol_definitions(board_config.pwm_mappings[1])),
-            make_protocol_object("gpio3_pwm_mapping", make_protocol_definitions(board_config.pwm_mappings[2])),
+            make_protocol_object("gpio1_pwm_mapping", make_protocol_definitions(board_config.pwm_mappings[0], pwm_input_mappings[0])),
+            make_protocol_object("gpio2_pwm_mapping", make_protocol_definitions(board_config.pwm_mappings[1], pwm_input_mappings[1])),
+            make_protocol_object("gpio3_pwm_mapping", make_protocol_definitions(board_config.pwm_mappings[2], pwm_input_mappings[2])),
 #endif
-            make_protocol_object("gpio4_pwm_mapping", make_protocol_definitions(board_config.pwm_mappings[3])),
+            make_protocol_object("gpio4_pwm_mapping", make_protocol_definitions(board_config.pwm_mappings[3], pwm_input_mappings[3])),
 
-            make_protocol_object("gpio3_analog_mapping", make_protocol_definitions(board_config.analog_mappings[2])),
-            make_protocol_object("gpio4_analog_mapping", make_protocol_definitions(board_config.analog_mappings[3]))
+            make_protocol_object("gpio3_analog_mapping", make_protocol_definitions(board_config.analog_mappings[2], analog_input_mappings[2])),
+            make_protocol_object("gpio4_analog_mapping", make_protocol_definitions(board_config.analog_mappings[3], analog_input_mappings[3]))
             ),
         make_protocol_object("axis0", axes[0]->make_protocol_definitions()),
         make_protocol_object("axis1", axes[1]->make_protocol_definitions()),
+        make_protocol_object("motion_planner", motion_planner->make_protocol_definitions()),
         make_protocol_object("can", can1_ctx.make_protocol_definitions()),
         make_protocol_property("test_property", &test_property),
         make_protocol_function("test_function", static_functions, &StaticFunctions::test_function, "delta"),
         make_protocol_function("get_oscilloscope_val", static_functions, &StaticFunctions::get_oscilloscope_val, "index"),
         make_protocol_function("get_adc_voltage", static_functions, &StaticFunctions::get_adc_voltage_, "gpio"),
+        make_protocol_function("get_adc_filter_bandwidth", static_functions, &StaticFunctions::get_adc_filter_bandwidth, "channel"),
+        make_protocol_function("set_adc_filter_bandwidth", static_functions, &StaticFunctions::set_adc_filter_bandwidth, "channel", "bandwidth"),
         make_protocol_function("save_configuration", static_functions, &StaticFunctions::save_configuration_helper),
         make_protocol_function("erase_configuration", static_functions, &StaticFunctions::erase_configuration_helper),
         make_protocol_function("reboot", static_functions, &StaticFunctions::NVIC_SystemReset_helper),
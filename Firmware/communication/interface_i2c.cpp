@@ -1,12 +1,14 @@
 
 #include "interface_i2c.h"
 #include "fibre/protocol.hpp"
+#include "odrive_main.h"
 
 #include <i2c.h>
 
 #define I2C_RX_BUFFER_SIZE 128
 #define I2C_RX_BUFFER_PREAMBLE_SIZE   4
 #define I2C_TX_BUFFER_SIZE 128
+#define I2C_REGISTER_MAP_PADDING 16 // returned as zeros if the master reads past the end of the map
 
 I2CStats_t i2c_stats_ = {0};
 
@@ -24,6 +26,104 @@ public:
 } i2c1_packet_output;
 BidirectionalPacketBasedChannel i2c1_channel(i2c1_packet_output);
 
+// Snapshot of the register map, taken at the start of each read transaction
+static uint8_t i2c_register_map[I2C_REG_MAP_SIZE + I2C_REGISTER_MAP_PADDING];
+static bool i2c_register_map_selected = false;
+static uint16_t i2c_register_offset = 0;
+
+static void i2c_update_register_map() {
+    for (size_t i = 0; i < AXIS_COUNT; ++i) {
+        Axis& axis = *axes[i];
+        uint8_t* regs = i2c_register_map + i * I2C_REG_AXIS_STRIDE;
+        write_le<float>(axis.controller_.pos_setpoint_, regs + I2C_REG_POS_SETPOINT);
+        write_le<float>(axis.controller_.vel_setpoint_, regs + I2C_REG_VEL_SETPOINT);
+        write_le<float>(axis.controller_.current_setpoint_, regs + I2C_REG_CURRENT_SETPOINT);
+        write_le<uint32_t>(axis.requested_state_, regs + I2C_REG_REQUESTED_STATE);
+        write_le<float>(axis.encoder_.pos_estimate_, regs + I2C_REG_POS_ESTIMATE);
+        write_le<float>(axis.encoder_.vel_estimate_, regs + I2C_REG_VEL_ESTIMATE);
+        write_le<float>(axis.motor_.current_control_.Iq_measured, regs + I2C_REG_IQ_MEASURED);
+        write_le<uint32_t>(axis.current_state_, regs + I2C_REG_CURRENT_STATE);
+        write_le<uint32_t>(axis.error_, regs + I2C_REG_AXIS_ERROR);
+    }
+    write_le<float>(vbus_voltage, i2c_register_map + I2C_REG_VBUS_VOLTAGE);
+}
+
+// @brief Writes a single 32-bit register. Writes to read-only registers are ignored.
+static void i2c_write_register(uint16_t reg, const uint8_t* data) {
+    size_t axis_number = reg / I2C_REG_AXIS_STRIDE;
+    if (axis_number >= AXIS_COUNT)
+        return; // board registers are read-only
+    Axis& axis = *axes[axis_number];
+    switch (reg % I2C_REG_AXIS_STRIDE) {
+        case I2C_REG_POS_SETPOINT: read_le<float>(&axis.controller_.pos_setpoint_, data); break;
+        case I2C_REG_VEL_SETPOINT: read_le<float>(&axis.controller_.vel_setpoint_, data); break;
+        case I2C_REG_CURRENT_SETPOINT: read_le<float>(&axis.controller_.current_setpoint_, data); break;
+        case I2C_REG_REQUESTED_STATE: {
+            uint32_t state;
+            read_le<uint32_t>(&state, data);
+            axis.requested_state_ = static_cast<Axis::State_t>(state);
+        } break;
+        default: return;
+    }
+    axis.watchdog_feed();
+}
+
+// @brief Handles a write transaction to the register map.
+// The first two bytes are the register address. They are followed by
+// zero or more 32-bit register values. A write without values only sets
+// the register address for subsequent reads.
+static void i2c_handle_register_write(uint16_t reg, const uint8_t* data, size_t length) {
+    i2c_register_offset = reg;
+    if (reg % 4)
+        return; // unaligned writes are ignored
+    for (; length >= 4; length -= 4, data += 4, reg += 4)
+        i2c_write_register(reg, data);
+}
+
+// @brief Starts a DMA transfer of the register map, beginning at the
+// current register offset. The transfer ends when the master NACKs.
+static void i2c_start_register_read(I2C_HandleTypeDef *hi2c) {
+    i2c_update_register_map();
+    uint16_t offset = i2c_register_offset < I2C_REG_MAP_SIZE ? i2c_register_offset : I2C_REG_MAP_SIZE;
+
+    // Stay in LISTEN state so that the HAL completes the listen cycle on
+    // the final NACK (see I2C_Slave_AF)
+    hi2c->XferOptions = I2C_FIRST_AND_LAST_FRAME;
+    HAL_DMA_Start(hi2c->hdmatx, (uint32_t)(i2c_register_map + offset),
+                  (uint32_t)&hi2c->Instance->DR, sizeof(i2c_register_map) - offset);
+    hi2c->Instance->CR2 |= I2C_CR2_DMAEN;
+
+    // Release the clock stretching, the DMA takes over from here
+    __HAL_I2C_CLEAR_ADDRFLAG(hi2c);
+}
+
+static void i2c_stop_register_read(I2C_HandleTypeDef *hi2c) {
+    if (hi2c->Instance->CR2 & I2C_CR2_DMAEN) {
+        hi2c->Instance->CR2 &= ~I2C_CR2_DMAEN;
+        HAL_DMA_Abort(hi2c->hdmatx);
+    }
+}
+
+// @brief Reads several endpoints into the TX buffer, one after another.
+// The request is a list of 16-bit endpoint IDs followed by the JSON CRC.
+static void i2c_handle_batch_read(const uint8_t* data, size_t length) {
+    if (length < 2 || (length % 2))
+        return;
+    uint16_t trailer;
+    read_le<uint16_t>(&trailer, data + length - 2);
+    if (trailer != json_crc_)
+        return;
+
+    MemoryStreamSink output(i2c_tx_buffer, sizeof(i2c_tx_buffer));
+    for (size_t i = 0; i + 2 < length; i += 2) {
+        uint16_t endpoint_id;
+        read_le<uint16_t>(&endpoint_id, data + i);
+        if (endpoint_id == 0 || endpoint_id >= n_endpoints_ || !endpoint_list_[endpoint_id])
+            return;
+        endpoint_list_[endpoint_id]->handle(nullptr, 0, &output);
+    }
+}
+
 void start_i2c_server() {
     // CAN H = SDA
     // CAN L = SCL
@@ -32,9 +132,34 @@ void start_i2c_server() {
 
 void i2c_handle_packet(I2C_HandleTypeDef *hi2c) {
     size_t received = sizeof(i2c_rx_buffer) - hi2c->XferCount;
-    if (received > I2C_RX_BUFFER_PREAMBLE_SIZE) {
+    uint16_t address = 0;
+    if (received >= I2C_RX_BUFFER_PREAMBLE_SIZE + 2)
+        read_le<uint16_t>(&address, i2c_rx_buffer + I2C_RX_BUFFER_PREAMBLE_SIZE);
+
+    if (address & I2C_REGISTER_MAP_FLAG) {
+        i2c_stats_.rx_cnt++;
+
+        i2c_register_map_selected = true;
+        i2c_handle_register_write(address & ~I2C_REGISTER_MAP_FLAG,
+                i2c_rx_buffer + I2C_RX_BUFFER_PREAMBLE_SIZE + 2, received - I2C_RX_BUFFER_PREAMBLE_SIZE - 2);
+
+        // reset receive buffer
+        hi2c->pBuffPtr = I2C_RX_BUFFER_PREAMBLE_SIZE + i2c_rx_buffer;
+        hi2c->XferCount = sizeof(i2c_rx_buffer) - I2C_RX_BUFFER_PREAMBLE_SIZE;
+    } else if (address == I2C_BATCH_READ_ADDRESS) {
+        i2c_stats_.rx_cnt++;
+        i2c_register_map_selected = false;
+
+        i2c_handle_batch_read(i2c_rx_buffer + I2C_RX_BUFFER_PREAMBLE_SIZE + 2,
+                received - I2C_RX_BUFFER_PREAMBLE_SIZE - 2);
+
+        // reset receive buffer
+        hi2c->pBuffPtr = I2C_RX_BUFFER_PREAMBLE_SIZE + i2c_rx_buffer;
+        hi2c->XferCount = sizeof(i2c_rx_buffer) - I2C_RX_BUFFER_PREAMBLE_SIZE;
+    } else if (received > I2C_RX_BUFFER_PREAMBLE_SIZE) {
         i2c_stats_.rx_cnt++;
-        
+        i2c_register_map_selected = false;
+
         write_le<uint16_t>(0, i2c_rx_buffer); // hallucinate seq-no (not needed for I2C)
         i2c_rx_buffer[2] = i2c_rx_buffer[4]; // endpoint-id = I2C register address
         i2c_rx_buffer[3] = i2c_rx_buffer[5] | 0x80; // MSB must be 1
@@ -55,6 +180,7 @@ void i2c_handle_packet(I2C_HandleTypeDef *hi2c) {
 
 
 void HAL_I2C_ListenCpltCallback(I2C_HandleTypeDef *hi2c) {
+    i2c_stop_register_read(hi2c);
     i2c_handle_packet(hi2c);
     // restart listening for address
     HAL_I2C_EnableListen_IT(hi2c);
@@ -69,6 +195,8 @@ void HAL_I2C_AddrCallback(I2C_HandleTypeDef *hi2c, uint8_t TransferDirection, ui
         HAL_I2C_Slave_Sequential_Receive_IT(hi2c,
             I2C_RX_BUFFER_PREAMBLE_SIZE + i2c_rx_buffer,
             sizeof(i2c_rx_buffer) - I2C_RX_BUFFER_PREAMBLE_SIZE, I2C_FIRST_AND_LAST_FRAME);
+    } else if (i2c_register_map_selected) {
+        i2c_start_register_read(hi2c);
     } else {
         HAL_I2C_Slave_Sequential_Transmit_IT(hi2c, i2c_tx_buffer, sizeof(i2c_tx_buffer), I2C_FIRST_AND_LAST_FRAME);
     }
@@ -80,6 +208,7 @@ void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c) {
         return;
 
     i2c_stats_.error_cnt += 1;
+    i2c_stop_register_read(hi2c);
 
     // Continue listening
     HAL_I2C_EnableListen_IT(hi2c);
@@ -7,6 +7,32 @@ extern "C" {
 
 #include <stdint.h>
 
+// Batched read: the request is a list of 16-bit endpoint IDs followed by the
+// JSON CRC. The response is the concatenation of the endpoint values.
+#define I2C_BATCH_READ_ADDRESS      0x7FFF
+
+// Register map fast path
+// Register addresses with this bit set bypass the generic protocol and access
+// the fixed register map below. All registers are 32 bit little endian and
+// consecutive registers can be read in a single burst.
+#define I2C_REGISTER_MAP_FLAG       0x8000
+
+// Per-axis registers (add axis number * I2C_REG_AXIS_STRIDE)
+#define I2C_REG_AXIS_STRIDE         0x30
+#define I2C_REG_POS_SETPOINT        0x00 // float, rw
+#define I2C_REG_VEL_SETPOINT        0x04 // float, rw
+#define I2C_REG_CURRENT_SETPOINT    0x08 // float, rw
+#define I2C_REG_REQUESTED_STATE     0x0C // uint32, rw
+#define I2C_REG_POS_ESTIMATE        0x10 // float, ro
+#define I2C_REG_VEL_ESTIMATE        0x14 // float, ro
+#define I2C_REG_IQ_MEASURED         0x18 // float, ro
+#define I2C_REG_CURRENT_STATE       0x1C // uint32, ro
+#define I2C_REG_AXIS_ERROR          0x20 // uint32, ro
+
+// Board registers
+#define I2C_REG_VBUS_VOLTAGE        0x60 // float, ro
+#define I2C_REG_MAP_SIZE            0x64
+
 struct I2CStats_t {
     uint8_t addr;
     uint32_t addr_match_cnt;
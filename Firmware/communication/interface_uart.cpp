@@ -86,6 +86,8 @@ static void uart_server_thread(void * ctx) {
             dma_last_rcv_idx = new_rcv_idx;
         }
 
+        ASCII_protocol_stream_feedback(uart4_stream_output);
+
         osDelay(1);
     };
 }
@@ -118,8 +118,10 @@ static void usb_server_thread(void * ctx) {
     (void) ctx;
     
     for (;;) {
-        // const uint32_t usb_check_timeout = 1; // ms
-        osStatus sem_stat = osSemaphoreWait(sem_usb_rx, osWaitForever);
+        // Wake up either on incoming data or when the next line of an
+        // active ASCII feedback stream is due
+        uint32_t timeout = ASCII_protocol_stream_feedback(usb_stream_output);
+        osStatus sem_stat = osSemaphoreWait(sem_usb_rx, timeout);
         if (sem_stat == osOK) {
             usb_stats_.rx_cnt++;
 
@@ -0,0 +1,316 @@
+#ifndef __NUMBER_CONVERSION_HPP
+#define __NUMBER_CONVERSION_HPP
+
+/*
+* Allocation-free conversion between numbers and their decimal text representation.
+*
+* These functions are a lightweight replacement for sscanf/snprintf with "%u", "%d"
+* and "%f". They never allocate, use very little stack and don't depend on the
+* float support of the C library, which is slow and stack-hungry on newlib-nano.
+*
+* All parse functions take a buffer that does not need to be null-terminated
+* and return the number of characters consumed, or 0 if no number was found.
+*
+* All format functions behave like snprintf: the output is always null-terminated
+* (if length > 0) and the return value is the number of characters written,
+* excluding the null-terminator. If the buffer is too small, the output is truncated.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+
+namespace number_conversion {
+
+static const float pow10_table[] = {
+    1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f,
+    1e10f, 1e11f, 1e12f, 1e13f, 1e14f, 1e15f, 1e16f, 1e17f, 1e18f, 1e19f,
+    1e20f, 1e21f, 1e22f, 1e23f, 1e24f, 1e25f, 1e26f, 1e27f, 1e28f, 1e29f,
+    1e30f, 1e31f, 1e32f, 1e33f, 1e34f, 1e35f, 1e36f, 1e37f, 1e38f
+};
+static constexpr int pow10_table_max = sizeof(pow10_table) / sizeof(pow10_table[0]) - 1;
+
+// Number of fractional digits emitted by format_float.
+// This matches the precision of printf's "%f".
+static constexpr int float_decimals = 6;
+
+// Values at or above this magnitude are formatted in exponential notation.
+static constexpr float float_exp_threshold = 4294967296.0f; // 2^32
+
+static inline bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' || c == '\f';
+}
+
+static inline bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+// @brief Returns 10^exp for exp in [-45, 38] (saturating to 0 or infinity outside this range)
+static inline float pow10f_fast(int exp) {
+    if (exp >= 0) {
+        if (exp > pow10_table_max)
+            return INFINITY;
+        return pow10_table[exp];
+    } else {
+        if (-exp > 2 * pow10_table_max)
+            return 0.0f;
+        if (-exp > pow10_table_max)
+            return 1.0f / pow10_table[pow10_table_max] / pow10_table[-exp - pow10_table_max];
+        return 1.0f / pow10_table[-exp];
+    }
+}
+
+// @brief Parses the digits of an unsigned decimal integer (no sign, no whitespace).
+// Saturates at UINT32_MAX.
+static inline size_t parse_digits(const char* buffer, size_t length, uint32_t* value) {
+    uint32_t result = 0;
+    size_t pos = 0;
+    for (; pos < length && is_digit(buffer[pos]); ++pos) {
+        uint32_t digit = (uint32_t)(buffer[pos] - '0');
+        if (result > (UINT32_MAX - digit) / 10)
+            result = UINT32_MAX;
+        else
+            result = result * 10 + digit;
+    }
+    if (pos)
+        *value = result;
+    return pos;
+}
+
+// @brief Parses an unsigned decimal integer. Leading whitespace is skipped.
+static inline size_t parse_uint(const char* buffer, size_t length, uint32_t* value) {
+    size_t pos = 0;
+    while (pos < length && is_space(buffer[pos]))
+        ++pos;
+    if (pos < length && buffer[pos] == '+')
+        ++pos;
+    size_t n_digits = parse_digits(buffer + pos, length - pos, value);
+    return n_digits ? (pos + n_digits) : 0;
+}
+
+// @brief Parses a signed decimal integer. Leading whitespace is skipped.
+static inline size_t parse_int(const char* buffer, size_t length, int32_t* value) {
+    size_t pos = 0;
+    while (pos < length && is_space(buffer[pos]))
+        ++pos;
+    bool negative = false;
+    if (pos < length && (buffer[pos] == '-' || buffer[pos] == '+'))
+        negative = buffer[pos++] == '-';
+    uint32_t magnitude;
+    size_t n_digits = parse_digits(buffer + pos, length - pos, &magnitude);
+    if (!n_digits)
+        return 0;
+    if (negative)
+        *value = (magnitude >= (uint32_t)INT32_MAX + 1) ? INT32_MIN : -(int32_t)magnitude;
+    else
+        *value = (magnitude >= (uint32_t)INT32_MAX) ? INT32_MAX : (int32_t)magnitude;
+    return pos + n_digits;
+}
+
+// @brief Parses a decimal floating point number of the form
+// [+-]digits[.digits][(e|E)[+-]digits], as well as "inf" and "nan".
+// Leading whitespace is skipped.
+static inline size_t parse_float(const char* buffer, size_t length, float* value) {
+    size_t pos = 0;
+    while (pos < length && is_space(buffer[pos]))
+        ++pos;
+    bool negative = false;
+    if (pos < length && (buffer[pos] == '-' || buffer[pos] == '+'))
+        negative = buffer[pos++] == '-';
+
+    // special values
+    if (pos + 3 <= length) {
+        char c0 = buffer[pos] | 0x20, c1 = buffer[pos + 1] | 0x20, c2 = buffer[pos + 2] | 0x20;
+        if (c0 == 'i' && c1 == 'n' && c2 == 'f') {
+            *value = negative ? -INFINITY : INFINITY;
+            return pos + 3;
+        } else if (c0 == 'n' && c1 == 'a' && c2 == 'n') {
+            *value = NAN;
+            return pos + 3;
+        }
+    }
+
+    // Mantissa: accumulate up to 9 significant digits in an integer,
+    // beyond that only keep track of the decimal exponent.
+    uint32_t mantissa = 0;
+    int n_significant = 0;
+    int exponent = 0;
+    bool any_digits = false;
+    for (; pos < length && is_digit(buffer[pos]); ++pos) {
+        any_digits = true;
+        if (n_significant < 9) {
+            mantissa = mantissa * 10 + (uint32_t)(buffer[pos] - '0');
+            if (mantissa)
+                n_significant++;
+        } else {
+            exponent++;
+        }
+    }
+    if (pos < length && buffer[pos] == '.') {
+        ++pos;
+        for (; pos < length && is_digit(buffer[pos]); ++pos) {
+            any_digits = true;
+            if (n_significant < 9) {
+                mantissa = mantissa * 10 + (uint32_t)(buffer[pos] - '0');
+                if (mantissa)
+                    n_significant++;
+                exponent--;
+            }
+        }
+    }
+    if (!any_digits)
+        return 0;
+
+    // Optional exponent. If it is malformed it is not consumed (same as strtof).
+    if (pos < length && (buffer[pos] | 0x20) == 'e') {
+        size_t exp_pos = pos + 1;
+        bool exp_negative = false;
+        if (exp_pos < length && (buffer[exp_pos] == '-' || buffer[exp_pos] == '+'))
+            exp_negative = buffer[exp_pos++] == '-';
+        uint32_t exp_value;
+        size_t n_exp_digits = parse_digits(buffer + exp_pos, length - exp_pos, &exp_value);
+        if (n_exp_digits) {
+            if (exp_value > 100)
+                exp_value = 100;
+            exponent += exp_negative ? -(int)exp_value : (int)exp_value;
+            pos = exp_pos + n_exp_digits;
+        }
+    }
+
+    float result = (float)mantissa;
+    if (mantissa && exponent) {
+        // Split very small exponents so that intermediate results stay in range
+        while (exponent < -pow10_table_max) {
+            result /= pow10_table[pow10_table_max];
+            exponent += pow10_table_max;
+        }
+        result = (exponent > 0) ? (result * pow10f_fast(exponent))
+                                : (result / pow10_table[-exponent]);
+    }
+    *value = negative ? -result : result;
+    return pos;
+}
+
+// @brief Writes the decimal representation of value right-aligned into
+// a scratch buffer of at least 10 characters and returns a pointer to the
+// first character. The output is not null-terminated.
+static inline char* format_digits_reverse(uint32_t value, char* scratch_end) {
+    do {
+        *(--scratch_end) = (char)('0' + (value % 10));
+        value /= 10;
+    } while (value);
+    return scratch_end;
+}
+
+// @brief Appends n characters from str to buffer and returns the new position.
+static inline size_t append_chars(char* buffer, size_t length, size_t pos, const char* str, size_t n) {
+    for (size_t i = 0; i < n && pos + 1 < length; ++i)
+        buffer[pos++] = str[i];
+    return pos;
+}
+
+static inline size_t terminate(char* buffer, size_t length, size_t pos) {
+    if (length)
+        buffer[pos < length ? pos : length - 1] = 0;
+    return pos;
+}
+
+static inline size_t format_uint(uint32_t value, char* buffer, size_t length) {
+    char scratch[10];
+    char* start = format_digits_reverse(value, scratch + sizeof(scratch));
+    size_t pos = append_chars(buffer, length, 0, start, (scratch + sizeof(scratch)) - start);
+    return terminate(buffer, length, pos);
+}
+
+static inline size_t format_int(int32_t value, char* buffer, size_t length) {
+    char scratch[11];
+    uint32_t magnitude = value < 0 ? (uint32_t)0 - (uint32_t)value : (uint32_t)value;
+    char* start = format_digits_reverse(magnitude, scratch + sizeof(scratch));
+    if (value < 0)
+        *(--start) = '-';
+    size_t pos = append_chars(buffer, length, 0, start, (scratch + sizeof(scratch)) - start);
+    return terminate(buffer, length, pos);
+}
+
+// @brief Formats a float in a compact decimal representation.
+//
+// Values with a magnitude below 2^32 are formatted in fixed point notation with
+// up to 6 fractional digits (trailing zeros are dropped, but at least one
+// fractional digit is kept), e.g. "24.087744", "-3.5", "0.0".
+// Larger values are formatted in exponential notation, e.g. "1.5e+12".
+// Non-finite values are formatted as "inf", "-inf" and "nan".
+static inline size_t format_float(float value, char* buffer, size_t length) {
+    char scratch[24];
+    char* end = scratch + sizeof(scratch);
+    char* start = end;
+
+    if (value != value) {
+        return terminate(buffer, length, append_chars(buffer, length, 0, "nan", 3));
+    }
+    bool negative = value < 0.0f;
+    float magnitude = negative ? -value : value;
+    if (magnitude > 3.40282347e+38f) {
+        size_t pos = negative ? append_chars(buffer, length, 0, "-inf", 4) : append_chars(buffer, length, 0, "inf", 3);
+        return terminate(buffer, length, pos);
+    }
+
+    if (magnitude < float_exp_threshold) {
+        // The integer part fits into 32 bits and subtracting it is exact.
+        uint32_t int_part = (uint32_t)magnitude;
+        float frac = magnitude - (float)int_part;
+        uint32_t frac_digits = (uint32_t)(frac * pow10_table[float_decimals] + 0.5f);
+        if (frac_digits >= (uint32_t)pow10_table[float_decimals]) {
+            frac_digits -= (uint32_t)pow10_table[float_decimals];
+            int_part++;
+        }
+
+        // fractional part, with trailing zeros dropped
+        int n_frac = float_decimals;
+        while (n_frac > 1 && (frac_digits % 10) == 0) {
+            frac_digits /= 10;
+            n_frac--;
+        }
+        for (int i = 0; i < n_frac; ++i) {
+            *(--start) = (char)('0' + (frac_digits % 10));
+            frac_digits /= 10;
+        }
+        *(--start) = '.';
+        start = format_digits_reverse(int_part, start);
+    } else {
+        // Exponential notation with 7 significant digits: d.dddddde+XX
+        int exponent = 9;
+        while (exponent < pow10_table_max && magnitude >= pow10_table[exponent + 1])
+            exponent++;
+        uint32_t digits = (uint32_t)(magnitude / pow10_table[exponent - 6] + 0.5f);
+        if (digits >= 10000000) {
+            digits /= 10;
+            exponent++;
+        }
+        char* exp_start = format_digits_reverse((uint32_t)exponent, end);
+        if (end - exp_start < 2)
+            *(--exp_start) = '0';
+        *(--exp_start) = '+';
+        *(--exp_start) = 'e';
+        start = exp_start;
+        int n_frac = 6;
+        while (n_frac > 1 && (digits % 10) == 0) {
+            digits /= 10;
+            n_frac--;
+        }
+        for (int i = 0; i < n_frac; ++i) {
+            *(--start) = (char)('0' + (digits % 10));
+            digits /= 10;
+        }
+        *(--start) = '.';
+        *(--start) = (char)('0' + digits);
+    }
+
+    if (negative)
+        *(--start) = '-';
+    size_t pos = append_chars(buffer, length, 0, start, end - start);
+    return terminate(buffer, length, pos);
+}
+
+}
+
+#endif /* __NUMBER_CONVERSION_HPP */
@@ -15,6 +15,7 @@ see protocol.md for the protocol specification
 #include <string.h>
 #include "crc.hpp"
 #include "cpp_utils.hpp"
+#include "number_conversion.hpp"
 
 // Note that this option cannot be used to debug UART because it prints on UART
 //#define DEBUG_FIBRE
@@ -476,6 +477,7 @@ public:
     virtual bool get_string(char * output, size_t length) { return false; }
     virtual bool set_string(char * buffer, size_t length) { return false; }
     virtual bool set_from_float(float value) { return false; }
+    virtual bool is_plain_float() { return false; }
 };
 
 static inline int write_string(const char* str, StreamSink* output) {
@@ -559,10 +561,10 @@ static bool to_string(const T& value, char * buffer, size_t length, int) {
     snprintf(buffer, length, format_traits_t<T>::fmtp, value);
     return true;
 }
-// Special case for float because printf promotes float to double, and we get warnings
+// Special case for float because newlib's printf float support is slow and stack-hungry
 template<typename T = float>
 static bool to_string(const float& value, char * buffer, size_t length, int) {
-    snprintf(buffer, length, "%f", (double)value);
+    number_conversion::format_float(value, buffer, length);
     return true;
 }
 template<typename T = bool>
@@ -580,15 +582,15 @@ template<typename T, typename = typename format_traits_t<T>::type>
 static bool from_string(const char * buffer, size_t length, T* property, int) {
     return sscanf(buffer, format_traits_t<T>::fmt, property) == 1;
 }
-// Special case for float because printf promotes float to double, and we get warnings
+// Special case for float because newlib's scanf float support is slow and stack-hungry
 template<typename T = float>
 static bool from_string(const char * buffer, size_t length, float* property, int) {
-    return sscanf(buffer, "%f", property) == 1;
+    return number_conversion::parse_float(buffer, length, property) != 0;
 }
 template<typename T = bool>
 static bool from_string(const char * buffer, size_t length, bool* property, int) {
-    int val;
-    if (sscanf(buffer, "%d", &val) != 1)
+    int32_t val;
+    if (!number_conversion::parse_int(buffer, length, &val))
         return false;
     *property = val;
     return true;
@@ -819,6 +821,12 @@ public:
         return conversion::set_from_float(value, property_);
     }
 
+    // @brief True for a writable float without write hook. Such a property
+    // can be written with set_from_float() from interrupt context.
+    bool is_plain_float() final {
+        return std::is_same<TProperty, float>::value && written_hook_ == nullptr;
+    }
+
     void register_endpoints(Endpoint** list, size_t id, size_t length) {
         if (id < length)
             list[id] = this;
@@ -3,6 +3,8 @@
 #include <stdlib.h>
 #include <limits.h>
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
 
 //#define DEBUG_PROTOCOL
 void hexdump(const uint8_t* buf, size_t len);
@@ -10,6 +12,7 @@ void hexdump(const uint8_t* buf, size_t len);
 #include <fibre/crc.hpp>
 #include <fibre/decoders.hpp>
 #include <fibre/encoders.hpp>
+#include <fibre/number_conversion.hpp>
 
 void hexdump(const uint8_t* buf, size_t len) {
     for (size_t pos = 0; pos < len; ++pos) {
@@ -71,6 +74,162 @@ bool varint_decoder_test() {
 }
 
 
+bool number_conversion_test() {
+    using namespace number_conversion;
+
+    struct float_parse_case_t {
+        const char* text;
+        size_t consumed;
+        float expected;
+    };
+    const float_parse_case_t float_parse_cases[] = {
+        // text, consumed chars, parsed value
+        { "0", 1, 0.0f },
+        { "-20000", 6, -20000.0f },
+        { "24.087744", 9, 24.087744f },
+        { "  +1.5 2", 6, 1.5f },
+        { ".25", 3, 0.25f },
+        { "1e3", 3, 1000.0f },
+        { "-2.5E-3", 7, -0.0025f },
+        { "1e", 1, 1.0f },
+        { "3.14159265358979", 16, 3.14159265f },
+        { "0.000000123", 11, 1.23e-7f },
+        { "123456789012", 12, 123456789012.0f },
+    };
+    for (size_t i = 0; i < sizeof(float_parse_cases) / sizeof(float_parse_cases[0]); ++i) {
+        const float_parse_case_t& test_case = float_parse_cases[i];
+        float result = 0.0f;
+        size_t consumed = parse_float(test_case.text, strlen(test_case.text), &result);
+        float tolerance = 1e-6f * fabsf(test_case.expected);
+        if (consumed != test_case.consumed || fabsf(result - test_case.expected) > tolerance) {
+            printf("parse_float(\"%s\"): expected %g (%zu chars) but got %g (%zu chars)\n",
+                    test_case.text, (double)test_case.expected, test_case.consumed, (double)result, consumed);
+            return false;
+        }
+    }
+    const char* invalid_floats[] = { "", "-", ".", "abc", "e5" };
+    for (size_t i = 0; i < sizeof(invalid_floats) / sizeof(invalid_floats[0]); ++i) {
+        float result;
+        if (parse_float(invalid_floats[i], strlen(invalid_floats[i]), &result)) {
+            printf("parse_float(\"%s\"): expected failure\n", invalid_floats[i]);
+            return false;
+        }
+    }
+
+    float inf_result, nan_result;
+    if (pow10f_fast(39) != INFINITY || pow10f_fast(-77) != 0.0f || pow10f_fast(-1000) != 0.0f
+     || !(pow10f_fast(-45) > 0.0f) || pow10f_fast(-3) != 1e-3f
+     || parse_float("-inf", 4, &inf_result) != 4 || inf_result != -INFINITY
+     || parse_float("nan", 3, &nan_result) != 3 || !std::isnan(nan_result)) {
+        printf("pow10f_fast or special value parsing failed\n");
+        return false;
+    }
+
+    uint32_t uint_result;
+    int32_t int_result;
+    if (parse_uint("4294967295", 10, &uint_result) != 10 || uint_result != 4294967295u
+     || parse_uint("-1", 2, &uint_result) != 0
+     || parse_int("-2147483648", 11, &int_result) != 11 || int_result != INT32_MIN
+     || parse_int(" 42abc", 6, &int_result) != 3 || int_result != 42) {
+        printf("integer parsing failed\n");
+        return false;
+    }
+
+    struct float_format_case_t {
+        float value;
+        const char* expected;
+    };
+    const float_format_case_t float_format_cases[] = {
+        { 0.0f, "0.0" },
+        { 1.0f, "1.0" },
+        { -3.5f, "-3.5" },
+        { 24.087744f, "24.087744" },
+        { 0.0000004f, "0.0" },
+        { 0.9999996f, "1.0" },
+        { -20000.0f, "-20000.0" },
+        { 1.5e12f, "1.5e+12" },
+        { -1.234567e20f, "-1.234567e+20" },
+    };
+    for (size_t i = 0; i < sizeof(float_format_cases) / sizeof(float_format_cases[0]); ++i) {
+        char buffer[32];
+        format_float(float_format_cases[i].value, buffer, sizeof(buffer));
+        if (strcmp(buffer, float_format_cases[i].expected)) {
+            printf("format_float(%g): expected \"%s\" but got \"%s\"\n",
+                    (double)float_format_cases[i].value, float_format_cases[i].expected, buffer);
+            return false;
+        }
+    }
+
+    char buffer[8];
+    if (format_int(INT32_MIN, buffer, sizeof(buffer)) != 7 || strcmp(buffer, "-214748")) {
+        printf("format_int truncation failed: \"%s\"\n", buffer);
+        return false;
+    }
+    if (format_uint(0, buffer, sizeof(buffer)) != 1 || strcmp(buffer, "0")) {
+        printf("format_uint failed: \"%s\"\n", buffer);
+        return false;
+    }
+
+    // Round trip: formatting and parsing must give back the value within
+    // the precision of the fixed point representation.
+    for (float value = -10000.0f; value < 10000.0f; value += 0.37f) {
+        char text[32];
+        size_t len = format_float(value, text, sizeof(text));
+        float result;
+        if (parse_float(text, len, &result) != len || fabsf(result - value) > 1e-6f + 1e-6f * fabsf(value)) {
+            printf("round trip of %f failed: \"%s\" => %f\n", (double)value, text, (double)result);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// @brief Compares the speed of number_conversion against the C library.
+void number_conversion_benchmark() {
+    const size_t n_iterations = 1000000;
+    const char* samples[] = { "-20000", "24.087744", "0.5", "1234.5678", "-0.001" };
+    const size_t n_samples = sizeof(samples) / sizeof(samples[0]);
+    volatile float sink = 0.0f;
+    char buffer[32];
+
+    clock_t start = clock();
+    for (size_t i = 0; i < n_iterations; ++i) {
+        float value;
+        const char* sample = samples[i % n_samples];
+        number_conversion::parse_float(sample, strlen(sample), &value);
+        sink = sink + value;
+    }
+    double t_parse = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    start = clock();
+    for (size_t i = 0; i < n_iterations; ++i) {
+        float value;
+        sscanf(samples[i % n_samples], "%f", &value);
+        sink = sink + value;
+    }
+    double t_sscanf = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    start = clock();
+    for (size_t i = 0; i < n_iterations; ++i) {
+        number_conversion::format_float((float)i * 0.37f, buffer, sizeof(buffer));
+        sink = sink + buffer[0];
+    }
+    double t_format = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    start = clock();
+    for (size_t i = 0; i < n_iterations; ++i) {
+        snprintf(buffer, sizeof(buffer), "%f", (double)((float)i * 0.37f));
+        sink = sink + buffer[0];
+    }
+    double t_snprintf = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    printf("float parsing:    %6.1f ns (sscanf: %6.1f ns)\n",
+            t_parse * 1e9 / n_iterations, t_sscanf * 1e9 / n_iterations);
+    printf("float formatting: %6.1f ns (snprintf: %6.1f ns)\n",
+            t_format * 1e9 / n_iterations, t_snprintf * 1e9 / n_iterations);
+}
+
 
 int main(void) {
     /***** Decoder demo (remove or move somewhere else) *****/
@@ -128,8 +287,12 @@ int main(void) {
     }
 
 
+    /***** run benchmarks *****/
+    number_conversion_benchmark();
+
     /***** run automated test *****/
     bool test_result = varint_decoder_test();
+    test_result = number_conversion_test() && test_result;
     if (test_result) {
         printf("all tests passed\n");
         return 0;
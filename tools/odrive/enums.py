@@ -12,6 +12,8 @@ AXIS_STATE_ENCODER_OFFSET_CALIBRATION = 7
 AXIS_STATE_CLOSED_LOOP_CONTROL = 8
 AXIS_STATE_LOCKIN_SPIN = 9
 AXIS_STATE_ENCODER_DIR_FIND = 10
+AXIS_STATE_FLUX_LINKAGE_CALIBRATION = 11
+AXIS_STATE_ENCODER_SINCOS_CALIBRATION = 12
 
 class errors:
     class axis:
@@ -52,6 +54,8 @@ class errors:
         ERROR_UNSUPPORTED_ENCODER_MODE = 0x08
         ERROR_ILLEGAL_HALL_STATE = 0x10
         ERROR_INDEX_NOT_FOUND_YET = 0x20
+        ERROR_SINCOS_SIGNAL_OUT_OF_RANGE = 0x40
+        ERROR_ABS_SPI_COM_FAIL = 0x80
 
     class controller:
         ERROR_NONE = 0
@@ -61,6 +65,14 @@ MOTOR_TYPE_HIGH_CURRENT = 0
 #MOTOR_TYPE_LOW_CURRENT = 1
 MOTOR_TYPE_GIMBAL = 2
 
+CURRENT_CONTROL_MODE_PI = 0
+CURRENT_CONTROL_MODE_DEADBEAT = 1
+
+DPWM_MODE_NONE = 0
+DPWM_MODE_MIN = 1
+DPWM_MODE_MAX = 2
+DPWM_MODE_1 = 3
+
 CTRL_MODE_VOLTAGE_CONTROL = 0
 CTRL_MODE_CURRENT_CONTROL = 1
 CTRL_MODE_VELOCITY_CONTROL = 2
@@ -69,3 +81,6 @@ CTRL_MODE_TRAJECTORY_CONTROL = 4
 
 ENCODER_MODE_INCREMENTAL = 0
 ENCODER_MODE_HALL = 1
+ENCODER_MODE_SINCOS = 2
+ENCODER_MODE_SPI_ABS_CUI = 0x100
+ENCODER_MODE_SPI_ABS_AMS = 0x101